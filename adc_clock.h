@@ -0,0 +1,100 @@
+//======================================================================================
+/** \file  adc_clock.h
+ *  This file contains a template which picks the A/D converter's clock divider from
+ *  the CPU clock frequency and the resolution which is needed. Everything is worked
+ *  out by the compiler, so the register values come out as constants and there's no
+ *  setup math to do when the program runs.
+ *
+ *  The A/D converter needs a clock of 50 to 200 kHz to give its full 10 bits. If
+ *  fewer bits will do, the clock can be faster and conversions come quicker; the
+ *  limits used here are 500 kHz for 9 bits and 1 MHz for 8 bits. The fastest clock
+ *  which is no faster than the limit is used. The readings are still 10-bit numbers
+ *  either way, but at a faster clock the lowest bits are mostly noise.
+ *
+ *  Revisions:
+ *    \li  10-16-26  Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _ADC_CLOCK_H_                       // To prevent *.h file from being included
+#define _ADC_CLOCK_H_                       // in a source file more than once
+
+#include <avr/io.h>
+
+
+//-------------------------------------------------------------------------------------
+/** This template looks for the smallest A/D clock divider, 2 to the power SELECT, which
+ *  makes the A/D clock no faster than MAX_HZ. The general version is used when it has
+ *  been found, or when there are no bigger dividers to try.
+ */
+
+template <unsigned long CPU_HZ, unsigned long MAX_HZ, unsigned char SELECT = 1,
+          bool TOO_FAST = ((CPU_HZ >> SELECT) > MAX_HZ && SELECT < 7)>
+struct adc_divider
+    {
+    static const unsigned char SELECT_BITS = SELECT;    ///< Value for the ADPS bits
+    };
+
+/// This version of the template tries the next bigger divider
+template <unsigned long CPU_HZ, unsigned long MAX_HZ, unsigned char SELECT>
+struct adc_divider<CPU_HZ, MAX_HZ, SELECT, true>
+    : public adc_divider<CPU_HZ, MAX_HZ, SELECT + 1>
+    {
+    };
+
+
+//-------------------------------------------------------------------------------------
+/** This template holds the A/D converter settings for a CPU clock and resolution. For
+ *  example, for an 8 MHz clock and full 10-bit readings, use
+ *  \code
+ *    ADCSRA = adc_clock<8000000UL, 10>::ADCSRA_VALUE;
+ *  \endcode
+ *  A resolution other than 8 to 10 bits, or a CPU clock for which no divider gives an
+ *  A/D clock in range, won't compile.
+ *  @param CPU_HZ The CPU clock frequency in Hz, usually F_CPU
+ *  @param BITS The number of bits which must be good in each reading
+ */
+
+template <unsigned long CPU_HZ, unsigned char BITS = 10>
+class adc_clock
+    {
+    protected:
+        /// This causes a compiler error (negative array size) for a bad resolution
+        typedef char bits_check[(BITS >= 8 && BITS <= 10) ? 1 : -1];
+
+    public:
+        /// This is the fastest A/D clock which gives the number of bits needed
+        static const unsigned long MAX_HZ = (BITS >= 10) ? 200000UL
+                                          : (BITS == 9) ? 500000UL : 1000000UL;
+
+        /// This is the value for the ADPS bits which picks the divider
+        static const unsigned char SELECT_BITS = adc_divider<CPU_HZ, MAX_HZ>::SELECT_BITS;
+
+        /// This is the number by which the CPU clock is divided
+        static const unsigned char DIVIDER = (1 << SELECT_BITS);
+
+        /// This is the A/D clock frequency in Hz
+        static const unsigned long CLOCK_HZ = CPU_HZ / DIVIDER;
+
+        /// This is how many conversions can be done per second; each takes 13 clocks
+        static const unsigned long CONVERSION_HZ = CLOCK_HZ / 13;
+
+        /// This is ADCSRA with the converter on, no interrupts, and the divider set
+        static const unsigned char ADCSRA_VALUE = (1 << ADEN) | SELECT_BITS;
+
+        /// This is ADMUX with AVCC as the reference, right adjusted, and channel 0
+        static const unsigned char ADMUX_VALUE = (1 << REFS0);
+
+    protected:
+        /// This causes a compiler error if the CPU clock is too fast for any divider
+        typedef char fast_check[(CLOCK_HZ <= MAX_HZ) ? 1 : -1];
+
+        /// This causes a compiler error if the CPU clock is too slow for any divider
+        typedef char slow_check[(CLOCK_HZ >= 50000UL) ? 1 : -1];
+    };
+
+#endif // _ADC_CLOCK_H_
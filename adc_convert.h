@@ -0,0 +1,104 @@
+//======================================================================================
+/** \file  adc_convert.h
+ *  This file contains a template which converts A/D readings into millivolts. The
+ *  reference voltage, resolution, and result alignment are template parameters, so
+ *  all the constants are worked out by the compiler and a conversion takes a couple
+ *  of 16-bit multiplies and a shift, with no 32-bit math and no division.
+ *
+ *  The idea is that millivolts = reading * Vref / 2^bits can be written as
+ *  reading * Q - reading * D / 2^bits, where Q is Vref / 2^bits rounded up and D is
+ *  what's left over. The fraction D / 2^bits is reduced until its numerator is odd,
+ *  and if the products still fit in 16 bits, that's how the conversion is done. For
+ *  5000 mV and 10 bits this comes out as reading * 5 - reading * 15 / 128. When the
+ *  products won't fit, a 32-bit multiply and a shift are used instead.
+ *
+ *  Revisions:
+ *    \li  10-16-26  Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _ADC_CONVERT_H_                     // To prevent *.h file from being included
+#define _ADC_CONVERT_H_                     // in a source file more than once
+
+
+//-------------------------------------------------------------------------------------
+/** This template reduces the fraction NUM / 2^SHIFT by dividing the top and bottom by
+ *  two until the top is odd or the bottom is one. The general version is used when
+ *  the fraction can't be reduced any more.
+ */
+
+template <unsigned long NUM, unsigned char SHIFT,
+          bool EVEN = (NUM != 0 && NUM % 2 == 0 && SHIFT > 0)>
+struct adc_fraction
+    {
+    static const unsigned long NUMERATOR = NUM;     ///< Reduced top of the fraction
+    static const unsigned char SHIFT_BITS = SHIFT;  ///< Reduced bottom, as a power of 2
+    };
+
+/// This version of the template takes out one factor of two and tries again
+template <unsigned long NUM, unsigned char SHIFT>
+struct adc_fraction<NUM, SHIFT, true> : public adc_fraction<NUM / 2, SHIFT - 1>
+    {
+    };
+
+
+//-------------------------------------------------------------------------------------
+/** This template converts A/D readings into millivolts. For example, with a 5 volt
+ *  reference and right adjusted 10-bit results, use
+ *  \code
+ *    unsigned int mv = adc_millivolts<5000, 10, false>::convert (reading);
+ *  \endcode
+ *  Asking for a resolution which isn't from 1 to 16 bits won't compile.
+ *  @param VREF_MV The reference voltage in millivolts
+ *  @param BITS The number of bits in each reading
+ *  @param LEFT_ADJUST True if the readings are left adjusted (ADLAR set) 16-bit
+ *      register values, false if they're right adjusted
+ */
+
+template <unsigned int VREF_MV, unsigned char BITS = 10, bool LEFT_ADJUST = false>
+class adc_millivolts
+    {
+    protected:
+        /// This causes a compiler error (negative array size) for a bad resolution
+        typedef char bits_check[(BITS >= 1 && BITS <= 16) ? 1 : -1];
+
+        /// This is the largest reading there can be
+        static const unsigned long MAX_READING = (1UL << BITS) - 1;
+
+        /// This is Vref divided by the number of A/D steps, rounded up
+        static const unsigned long Q = (VREF_MV + MAX_READING) >> BITS;
+
+        /// This is the reduced fraction by which Q is too big
+        typedef adc_fraction<(Q << BITS) - VREF_MV, BITS> excess;
+
+        /// This is true if the multiply and subtract can all be done in 16 bits
+        static const bool FITS_16 = (Q * MAX_READING <= 0xFFFFUL)
+            && (excess::NUMERATOR * MAX_READING + (1UL << excess::SHIFT_BITS) - 1
+                <= 0xFFFFUL);
+
+    public:
+        /** This method converts one reading into millivolts, rounding down just as
+         *  reading * VREF_MV / 2^BITS would.
+         *  @param reading The reading from the A/D converter
+         *  @return The voltage in millivolts
+         */
+        static inline unsigned int convert (unsigned int reading)
+            {
+            if (LEFT_ADJUST)
+                reading >>= (16 - BITS);
+
+            if (FITS_16)
+                return ((unsigned int)Q * reading
+                    - (((unsigned int)excess::NUMERATOR * reading
+                        + (unsigned int)((1UL << excess::SHIFT_BITS) - 1))
+                       >> excess::SHIFT_BITS));
+            else
+                return ((unsigned int)(((unsigned long)reading * VREF_MV) >> BITS));
+            }
+    };
+
+#endif // _ADC_CONVERT_H_
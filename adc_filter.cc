@@ -0,0 +1,202 @@
+//*************************************************************************************
+/** \file adc_filter.cc
+ *        This file contains a digital filter which smooths the samples from one A/D
+ *        channel with an IIR, boxcar, or median filter. See adc_filter.h.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "adc_filter.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor makes a filter which passes each sample straight through.
+ */
+
+adc_filter::adc_filter (void)
+    {
+    type = FILTER_NONE;
+    size = 1;
+    size_bits = 0;
+    reset ();
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method picks the kind of filter and its size, and empties it. Interrupts are
+ *  held off meanwhile, so it can be done while the filter is attached to a channel.
+ *  @param new_type The kind of filter
+ *  @param new_size For an IIR filter, the shift, from 1 to ADC_IIR_MAX_SHIFT; each
+ *      sample moves the output 1/2^shift of the way to it. For a boxcar filter, the
+ *      number of samples averaged, which must be a power of two no bigger than
+ *      ADC_FILTER_LENGTH. For a median filter, the number of samples, from 1 to
+ *      ADC_FILTER_LENGTH; odd numbers work best
+ *  @return True if the filter was set up, false if the size won't work
+ */
+
+bool adc_filter::configure (adc_filter_type new_type, unsigned char new_size)
+    {
+    unsigned char bits = 0;
+
+    switch (new_type)
+        {
+        case (FILTER_NONE):
+            new_size = 1;
+            break;
+        case (FILTER_IIR):
+            if (new_size < 1 || new_size > ADC_IIR_MAX_SHIFT)
+                return (false);
+            break;
+        case (FILTER_BOXCAR):
+            if (new_size < 1 || new_size > ADC_FILTER_LENGTH
+                || (new_size & (new_size - 1)) != 0)
+                return (false);
+            while ((1 << bits) < new_size)
+                bits++;
+            break;
+        case (FILTER_MEDIAN):
+            if (new_size < 1 || new_size > ADC_FILTER_LENGTH)
+                return (false);
+            break;
+        default:
+            return (false);
+        };
+
+    unsigned char sreg = SREG;
+    cli ();
+    type = new_type;
+    size = new_size;
+    size_bits = bits;
+    reset ();
+    SREG = sreg;
+
+    return (true);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method empties the filter. The next sample will fill it, and until then the
+ *  output is zero.
+ */
+
+void adc_filter::reset (void)
+    {
+    empty = true;
+    oldest = 0;
+    sum = 0;
+    output = 0;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method fills the filter with one sample, as if it had been coming in for as
+ *  long as the filter remembers.
+ *  @param sample The sample
+ */
+
+void adc_filter::fill (unsigned int sample)
+    {
+    for (unsigned char index = 0; index < ADC_FILTER_LENGTH; index++)
+        {
+        history[index] = sample;
+        sorted[index] = sample;
+        }
+    oldest = 0;
+
+    if (type == FILTER_IIR)
+        sum = (unsigned long)sample << size;
+    else
+        sum = (unsigned long)sample << size_bits;
+
+    empty = false;
+    output = sample;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method takes in one sample and works out the new output. The IIR and boxcar
+ *  filters take a few additions and shifts; the median filter moves the new sample
+ *  into place in a sorted list, which takes at most ADC_FILTER_LENGTH steps. It's
+ *  called by the A/D interrupt routine, or can be called by the user's own code for
+ *  samples which come from somewhere else.
+ *  @param sample The new sample
+ */
+
+void adc_filter::update (unsigned int sample)
+    {
+    if (empty)
+        {
+        fill (sample);
+        return;
+        }
+
+    switch (type)
+        {
+        case (FILTER_IIR):
+            // The sum is the output times 2^size; move it 1/2^size toward the sample
+            sum = sum - (sum >> size) + sample;
+            output = (unsigned int)((sum + (1UL << (size - 1))) >> size);
+            break;
+
+        case (FILTER_BOXCAR):
+            sum = sum - history[oldest] + sample;
+            history[oldest] = sample;
+            if (++oldest >= size)
+                oldest = 0;
+            output = (unsigned int)(sum >> size_bits);
+            break;
+
+        case (FILTER_MEDIAN):
+            {
+            // Put the new sample where the oldest was in the sorted list, then move
+            // it along until the list is in order again
+            unsigned int old_sample = history[oldest];
+            unsigned char place = 0;
+
+            history[oldest] = sample;
+            if (++oldest >= size)
+                oldest = 0;
+
+            while (sorted[place] != old_sample)
+                place++;
+            while (place > 0 && sorted[place - 1] > sample)
+                {
+                sorted[place] = sorted[place - 1];
+                place--;
+                }
+            while (place < size - 1 && sorted[place + 1] < sample)
+                {
+                sorted[place] = sorted[place + 1];
+                place++;
+                }
+            sorted[place] = sample;
+            output = sorted[size / 2];
+            }
+            break;
+
+        default:
+            output = sample;
+            break;
+        };
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the filtered value. It's two bytes long and can be changed by
+ *  the A/D interrupt routine, so interrupts are held off while it's read.
+ *  @return The filtered value, or zero if no sample has come in yet
+ */
+
+unsigned int adc_filter::value (void)
+    {
+    unsigned char sreg = SREG;
+    cli ();
+    unsigned int copy = output;
+    SREG = sreg;
+
+    return (copy);
+    }
@@ -0,0 +1,98 @@
+//*************************************************************************************
+/** \file adc_filter.h
+ *        This file contains a digital filter which smooths the samples from one A/D
+ *        channel. It can be an exponential (IIR) filter, a moving average over a
+ *        boxcar of the last few samples, or the median of the last few samples,
+ *        which throws out spikes without blurring steps. All the arithmetic is done
+ *        in integers, and each new sample is taken in with a small, fixed amount of
+ *        work, so a filter can be run by the A/D interrupt routine for every sample.
+ *        A filter is attached to a channel with avr_adc::attach_filter(), and its
+ *        output is always ready to be read.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _ADC_FILTER_H_
+#define _ADC_FILTER_H_
+
+
+/// This is the most samples a boxcar or median filter can look at
+#define ADC_FILTER_LENGTH   8
+
+/// This is the largest shift an IIR filter can use; it then takes 1/256 of each change
+#define ADC_IIR_MAX_SHIFT   8
+
+
+//-------------------------------------------------------------------------------------
+/** This enumeration lists the kinds of filter.
+ */
+
+typedef enum {
+    FILTER_NONE,            ///< The output is just the last sample
+    FILTER_IIR,             ///< The output moves 1/2^size of the way to each sample
+    FILTER_BOXCAR,          ///< The output is the average of the last size samples
+    FILTER_MEDIAN           ///< The output is the median of the last size samples
+    } adc_filter_type;
+
+
+//-------------------------------------------------------------------------------------
+/** This class filters the samples from one A/D channel. Each sample is given to
+ *  update(), usually by the A/D interrupt routine, and the filtered value can be read
+ *  at any time with value(). The first sample after the filter is set up fills the
+ *  filter as if it had been coming in all along, so the output doesn't have to climb
+ *  up from zero.
+ */
+
+class adc_filter
+    {
+    protected:
+        /// This is the kind of filter
+        adc_filter_type type;
+
+        /// This is the IIR shift, or the number of samples in the boxcar or median
+        unsigned char size;
+
+        /// This is the boxcar length as a power of two, used to divide the sum
+        unsigned char size_bits;
+
+        /// This is true until the first sample has filled the filter
+        bool empty;
+
+        /// These are the last samples, oldest at history[oldest]
+        unsigned int history[ADC_FILTER_LENGTH];
+
+        /// These are the same samples in order from smallest to largest, for the median
+        unsigned int sorted[ADC_FILTER_LENGTH];
+
+        /// This is the index in history[] of the oldest sample
+        unsigned char oldest;
+
+        /// This is the sum of the boxcar, or the IIR output times 2^size
+        unsigned long sum;
+
+        /// This is the filtered value; it's changed by the A/D interrupt routine
+        volatile unsigned int output;
+
+        void fill (unsigned int);
+
+    public:
+        // The constructor makes a filter which passes samples straight through
+        adc_filter (void);
+
+        // This method picks the kind of filter and its size, and empties it
+        bool configure (adc_filter_type, unsigned char);
+
+        // This method empties the filter, so the next sample fills it
+        void reset (void);
+
+        // This method takes in a new sample
+        void update (unsigned int);
+
+        // This method returns the filtered value
+        unsigned int value (void);
+    };
+
+#endif  // _ADC_FILTER_H_
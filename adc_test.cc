@@ -8,6 +8,11 @@
  *    \li  01-01-00  Confusion
  *    \li  04-10-08  Man writes adc_test.cc
  *    \li  04-14-08  Man completes code/comments. There is much rejoycing
+ *    \li  10-16-26  Busy-wait loop replaced by tasks run by a timer driven scheduler
+ *    \li  10-16-26  Baud rate divisor worked out from F_CPU by the compiler
+ *    \li  10-16-26  Reports only channels which cross their thresholds
+ *    \li  10-16-26  Scans are time stamped to measure the sampling jitter
+ *    \li  10-16-26  Stack use and free RAM are watched and reported
  *
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
@@ -17,54 +22,215 @@
 
                                             // System headers included with < >
 #include <stdlib.h>                         // Standard C library
+#include <avr/interrupt.h>                  // Interrupt enable and disable macros
                                             // User written headers included with " "
 #include "rs232.h"                          // Include header for serial port class
 #include "avr_adc.h"                        // Include header for the A/D class
+#include "task_scheduler.h"                 // Include header for the task scheduler
+#include "mem_monitor.h"                    // Include header for the memory monitor
 
-/** This is the baud rate divisor for the serial port. It should give 9600 baud for the
- *  CPU crystal speed in use, for example 26 works for a 4MHz crystal on an ATmega8 
+/** This is the baud rate for the serial port. The divisor which makes it from the CPU
+ *  clock F_CPU is worked out by the compiler, which won't compile a rate that can't be
+ *  made closely enough
  */
-#define BAUD_DIV        52                  // For testing an ATmega128
+#define BAUD_RATE       9600
+
+/// This type holds the baud rate setting, and knows the rate it really makes
+typedef uart_baud<F_CPU, BAUD_RATE> test_baud;
+
+/// These are the channels which are sampled, as a bitmask, and how many there are
+#define TEST_CHANNELS   0x0F
+#define TEST_COUNT      4
+
+/** These are the thresholds for every channel, in millivolts. A channel is reported
+ *  only when its voltage goes below the low one or above the high one, or comes back
+ *  by more than the hysteresis
+ */
+#define TEST_LOW_MV     1000
+#define TEST_HIGH_MV    4000
+#define TEST_HYST_MV    100
+
+/// This converts millivolts into A/D counts, as the thresholds must be given
+#define MV_TO_COUNTS(mv) ((unsigned int)((mv) * 1024UL / ADC_VREF_MV))
+
+/// These are how often the tasks run, in scheduler ticks (milliseconds)
+#define SAMPLE_PERIOD   10                  // Sample all the channels at 100 Hz
+#define REPORT_PERIOD   100                 // Print any threshold crossings
+#define STATUS_PERIOD   10000               // Print the full status every 10 seconds
+
+
+//--------------------------------------------------------------------------------------
+/** This structure holds the things the tasks share. A pointer to it is given to each
+ *  task function by the scheduler.
+ */
+
+typedef struct
+    {
+    rs232* p_serial;                        ///< The serial port for printing
+    avr_adc* p_adc;                         ///< The A/D converter
+    task_scheduler* p_scheduler;            ///< The scheduler, for its statistics
+    mem_monitor* p_memory;                  ///< The memory monitor, for stack use
+    unsigned int frame[TEST_COUNT];         ///< One scan of the channels, from the ISR
+    } test_data;
+
+
+//--------------------------------------------------------------------------------------
+/** This task runs every SAMPLE_PERIOD ticks and starts a scan of the channels. The
+ *  A/D ISR checks each sample against the channel's thresholds as it comes in, so
+ *  there's nothing to do with the scan itself; it finishes in well under a 
+ *  millisecond, so it's done long before the next run. 
+ *  @param p_data A pointer to the shared test data
+ */
+
+static void sample_task (void* p_data)
+    {
+    test_data* p_test = (test_data*)p_data;
+
+    p_test->p_adc->start_scan (TEST_CHANNELS, p_test->frame, false);
+    }
+
+
+//--------------------------------------------------------------------------------------
+/** This task runs every REPORT_PERIOD ticks and prints one line listing the channels
+ *  which have crossed a threshold since the last time, with the voltage which took
+ *  each one across. When nothing has changed, nothing is printed, so the serial line
+ *  only carries as much as the inputs are doing. The line is short enough to fit in
+ *  the serial port's transmit buffer, so it goes out by interrupt without making the
+ *  sampling task wait. 
+ *  @param p_data A pointer to the shared test data
+ */
+
+static void report_task (void* p_data)
+    {
+    test_data* p_test = (test_data*)p_data;
+    adc_event event;
+
+    if (!p_test->p_adc->get_event (event))
+        return;
+
+    *p_test->p_serial << FLASH_STR ("Changed:");
+    do
+        {
+        event.value = adc_to_millivolts::convert (event.value);
+        *p_test->p_serial << FLASH_STR (" ") << event << FLASH_STR ("mV");
+        }
+    while (p_test->p_adc->get_event (event));
+    *p_test->p_serial << endl;
+    }
+
+
+//--------------------------------------------------------------------------------------
+/** This task runs every STATUS_PERIOD ticks and prints the A/D converter's status,
+ *  how the scheduler's tasks are keeping up, and how much stack has been used. This
+ *  report is much longer than the transmit buffer, so the task waits for the serial
+ *  port; if that makes the sampling task miss a run, the scheduler counts it as an
+ *  overrun.
+ *  @param p_data A pointer to the shared test data
+ */
+
+static void status_task (void* p_data)
+    {
+    test_data* p_test = (test_data*)p_data;
+
+    // Calls the overloaded << operator to print diagnostic information about
+    // the A/D conversion ports, including the time between the sampling task's scans
+    *p_test->p_serial << FLASH_STR ("A/D status:\n\r") << *p_test->p_adc << endl;
+
+    *p_test->p_serial << *p_test->p_scheduler << *p_test->p_memory << endl;
+
+    #ifdef PERF_COUNTERS
+        adc_counters adc_stats;
+        serial_counters serial_stats;
+
+        p_test->p_adc->get_counters (adc_stats);
+        p_test->p_serial->get_counters (serial_stats);
+        *p_test->p_serial << adc_stats << serial_stats << endl;
+    #endif
+    }
+
+
+//--------------------------------------------------------------------------------------
+/** This function is called by the memory monitor if the stack runs into the
+ *  variables. Some of them may have been overwritten, so it just prints a warning.
+ *  @param p_data A pointer to the shared test data
+ */
+
+static void stack_alarm (void* p_data)
+    {
+    test_data* p_test = (test_data*)p_data;
+
+    *p_test->p_serial << FLASH_STR ("Warning: stack overflow") << endl;
+    }
 
 
 //--------------------------------------------------------------------------------------
 /** The main function is the "entry point" of every C program, the one which runs first
  *  (after standard setup code has finished). For mechatronics programs, main() runs an
- *  infinite loop and never exits. 
+ *  infinite loop and never exits. Here that loop is in the scheduler, which runs the
+ *  tasks at their rates and sleeps the rest of the time. 
  */
 
 int main ()
     {
-    volatile unsigned long dummy;           // Used as a not-smart delay loop counter
-    unsigned int conversion;                // Data from the A/D
+    static test_data test;                  // Data shared among the tasks
+
+    // Create the memory monitor, which finds the RAM painted before main() was run
+    mem_monitor memory;
 
     // Create an RS232 serial port object. Diagnostic information can be printed out 
     // using this port
-    rs232 the_serial_port (BAUD_DIV, 1);
+    rs232 the_serial_port (test_baud (), 1);
+
+    // Let the transmitter interrupt send characters so printing doesn't hold us up
+    the_serial_port.use_tx_buffer (TX_BLOCK);
 
     // Create an ADC (Analog to Digital Converter) object. This object must be given a
     // pointer to the serial port object so that it can print debugging information
     avr_adc my_adc (&the_serial_port);
 
-    // Say hello
-    the_serial_port << "\r\nAnalog to Digital Test Program v0.002\r\n";
+    // Create the scheduler, which sets up a timer to make its ticks
+    task_scheduler scheduler;
 
-    // Run the main scheduling loop, in which the action to run is done repeatedly.
-    // In the future, we'll run tasks here; for now, just do things in a simple loop
-    while (true)
-        {
-        // The dummy counter is used to slow down the rate at which stuff is printed
-        // on the terminal
-        if (++dummy >= 1000000L)
-            {
-            dummy = 0;
+    test.p_serial = &the_serial_port;
+    test.p_adc = &my_adc;
+    test.p_scheduler = &scheduler;
+    test.p_memory = &memory;
 
+    // The scheduler checks the stack canary each time it checks the tasks
+    memory.set_callback (stack_alarm, &test);
+    scheduler.watch_memory (&memory);
 
-	    // Calls the overloaded << operator to print diagnostic information about
-	    // the A/D conversion ports
-            the_serial_port << "A/D status:\n\r" << my_adc << endl;
-            }
-        }
+    // Each scan is stamped with the time, so the status report can show how evenly
+    // the scheduler runs the sampling task
+    #ifdef ADC_TIMESTAMPS
+        my_adc.use_timestamps (true);
+    #endif
+
+    // Every channel gets the same window; the first scan reports where each starts
+    for (unsigned char channel = 0; channel < TEST_COUNT; channel++)
+        my_adc.set_window (channel, MV_TO_COUNTS (TEST_LOW_MV),
+                           MV_TO_COUNTS (TEST_HIGH_MV), MV_TO_COUNTS (TEST_HYST_MV));
+
+    // The tasks are checked in this order, so the one which must keep time goes first
+    scheduler.add_task (sample_task, &test, SAMPLE_PERIOD);
+    scheduler.add_task (report_task, &test, REPORT_PERIOD);
+    scheduler.add_task (status_task, &test, STATUS_PERIOD);
+
+    // The A/D, serial port and scheduler do their work in interrupt service routines,
+    // so turn interrupts on
+    sei ();
+
+    // Say hello
+    the_serial_port << FLASH_STR ("\r\nAnalog to Digital Test Program v0.007\r\n");
+    unsigned int error = labs (test_baud::ERROR_TENTHS);
+    the_serial_port << FLASH_STR ("Serial port at ") << test_baud::ACTUAL_BAUD
+                    << FLASH_STR (" baud, ")
+                    << (test_baud::ERROR_TENTHS < 0 ? FLASH_STR ("-") : FLASH_STR ("+"))
+                    << error / 10 << FLASH_STR (".") << error % 10
+                    << FLASH_STR ("% off") << endl;
+
+    // Run the tasks; this never returns
+    scheduler.run ();
 
     return (0);
     }
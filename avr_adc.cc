@@ -13,14 +13,18 @@
  */
 //======================================================================================
 
+#include <stdint.h>
 #include <stdlib.h>                         // Include standard library header files
 #include <avr/io.h>
+#include <avr/interrupt.h>
 
 #include "rs232.h"                          // Include header for serial port class
 #include "avr_adc.h"                        // Include header for the A/D class
 
 
-#define ADC_RETRIES      10000              // Retries before giving up on conversion
+#ifndef ADC_RETRIES                         // Retries before giving up on conversion;
+	#define ADC_RETRIES  10000              // can be changed on the command line
+#endif
 
 /** These defines make it easier for us to manipulate the bits of our registers, by
  * creating two new commands - cbi for clear bit i and sbi for set bit i
@@ -31,6 +35,13 @@
 #define sbi(reg, bit) reg |= (BV(bit))  // Sets the corresponding bit in register reg
 
 
+/** This pointer lets the A/D interrupt service routine find the A/D object. There's
+ *  only one A/D converter on the chip, so the most recently made object gets it
+ */
+
+static avr_adc* p_isr_adc = NULL;
+
+
 //-------------------------------------------------------------------------------------
 /** This union holds two bytes, making them accessable as both a two char array and
  *  a single 16 bit word
@@ -38,7 +49,7 @@
 
 typedef union ADC_result
 {
-	int word;                               // The whole 16-bit number
+	uint16_t word;                          // The whole 16-bit number
 	char bytes[2];                          // The bytes in the number
 };
 
@@ -53,77 +64,1474 @@ avr_adc::avr_adc (base_text_serial* p_serial_port)
 {
 	ptr_to_serial = p_serial_port;          // Store the serial port pointer locally
 
+	// Nothing's being converted and the ring buffer is empty
+	mode = ADC_IDLE;
+	sample_channel = 0;
+	buffer_head = 0;
+	buffer_tail = 0;
+	buffer_overruns = 0;
+	scan_count = 0;
+	scan_dest = NULL;
+	scan_storing = false;
+	scan_frame_ready = false;
+	block_filling = 0;
+	block_fill_count = 0;
+	block_ready = ADC_NO_BLOCK;
+	single_state = ADC_NO_RESULT;
+	single_result = 0xFFFF;
+	single_polls = 0;
+	timeout_count = 0;
+	callback = NULL;
+	p_callback_data = NULL;
+	timer_clock = 0;
+	timer_top = 0;
+	rate_achieved = 0;
+	rate_error = 0;
+	oversample_bits = 0;
+	oversample_ratio = 1;
+	for (unsigned char channel = 0; channel < 8; channel++)
+		p_filters[channel] = NULL;
+	window_mask = 0;
+	event_head = 0;
+	event_tail = 0;
+	events_lost = 0;
+	#ifdef ADC_TIMESTAMPS
+		stamping = false;
+		stamp_primed = false;
+		last_stamp = 0;
+		scan_stamp = 0;
+		clear_intervals ();
+	#endif
+	PERF_COUNT (clear_counters ());
+	p_isr_adc = this;
+
 	// Note that ptr_to_serial is a pointer; the "*" is needed to indicate "the serial
 	// port which is pointed to by the pointer" 
-	*ptr_to_serial << "Setting up AVR A/D converter" << endl;
+	*ptr_to_serial << FLASH_STR ("Setting up AVR A/D converter") << endl;
 
-	// Turns on A/D converter without interrupts and in single sample mode,
-	// with prescaler set to 64
-	ADCSRA = 0b10000110;
+	// Turns on A/D converter without interrupts and in single sample mode, with
+	// the fastest clock which gives ADC_RESOLUTION good bits at this F_CPU
+	ADCSRA = adc_config::ADCSRA_VALUE;
 
 	// Sets ADC result to right adjust, selects AVCChannel as Vref, and selects
 	// single-ended conversion on PF0
-	ADMUX = 0b01000000;
+	ADMUX = adc_config::ADMUX_VALUE;
 }
 
 
 //-------------------------------------------------------------------------------------
 /** This method takes one A/D reading from the given channel, and returns it as a
- *  16 bit value.
+ *  16 bit value. It waits for the conversion by calling poll() over and over, so it
+ *  gives up after ADC_RETRIES tries if the converter is stuck. 
  *  \param  channel The A/D channel which is being read must be from 0 to 7
- *  \return The result of the A/D conversion, or 0xFFFF if there was a timeout
+ *  \return The result of the A/D conversion, or 0xFFFF if there was a timeout or the
+ *          converter is busy streaming, capturing blocks or scanning
  */
 
 unsigned int avr_adc::read_once (unsigned char channel)
 {
-	ADMUX = ((ADMUX & 0b11100000) | channel);
-	sbi(ADCSRA,ADSC); // start a conversion by writing a one to the ADSC bit (bit 6)
+	if (!start (channel))
+		return (0xFFFF);
+
+	PERF_COUNT (unsigned int waits = 0);
+	while (poll () == ADC_BUSY)             // Wait for the conversion to complete
+		PERF_COUNT (waits++);
+
+	#ifdef PERF_COUNTERS
+		perf.waited++;
+		perf.wait_total += waits;
+		if (waits > perf.wait_max)
+			perf.wait_max = waits;
+	#endif
+
+	return (result ());
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts one A/D reading and returns right away, so the caller can get
+ *  on with other work while the conversion runs. Call poll() or ready() later to find
+ *  out if it's done, then result() to get the reading. If interrupts are on, the ISR
+ *  picks up the result as soon as it's ready and calls the callback function, if one
+ *  has been set; if they're off, poll() picks it up. If the converter is streaming,
+ *  capturing blocks or scanning, that's left running and no reading is begun; call
+ *  stop() first to take a reading in the middle of it. A conversion still running,
+ *  such as the one a one-shot scan leaves behind, is waited for, so its result can't
+ *  be taken for this one. 
+ *  \param  channel The A/D channel which is to be read, from 0 to 7
+ *  \return True if the reading was begun, false if the converter is busy
+ */
+
+bool avr_adc::start (unsigned char channel)
+{
+	if (mode == ADC_SINGLE)
+		stop ();
+	else if (mode != ADC_IDLE)
+	{
+		single_state = ADC_NO_RESULT;
+		return (false);
+	}
+
+	// Even when idle, a conversion may be running; setting ADSC wouldn't start a new
+	// one then, and the old one's result would come back as this reading
+	for (unsigned int tries = 0; (ADCSRA & BV(ADSC)) && tries < ADC_RETRIES; tries++);
+	sbi(ADCSRA, ADIF);
+
+	single_state = ADC_BUSY;
+	single_result = 0xFFFF;
+	single_polls = 0;
+	sample_channel = channel & 0x07;
+	mode = ADC_SINGLE;
+
+	// Only the multiplexer bits are changed, so a bad channel can't touch REFS or ADLAR
+	ADMUX = ((ADMUX & 0b11100000) | (channel & 0x1F));
+
+	// Clear any old interrupt flag, turn on the interrupt, and start the conversion
+	ADCSRA |= (BV(ADIF) | BV(ADIE) | BV(ADSC));
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method checks on a reading begun with start(). If the conversion has finished
+ *  but the ISR hasn't picked up the result, because interrupts are off, it's picked 
+ *  up here. Each call while the conversion is still running counts as one try; after
+ *  ADC_RETRIES tries the reading is given up on, and counted as a timeout, so a stuck
+ *  converter can't hang the program. 
+ *  \return ADC_BUSY, ADC_READY, ADC_TIMEOUT, or ADC_NO_RESULT if no reading was begun
+ */
+
+adc_status avr_adc::poll (void)
+{
+	if (single_state != ADC_BUSY)
+		return (single_state);
+
+	// Interrupts are held off so that the ISR and this can't both take the result
+	unsigned char sreg = SREG;
+	cli ();
+	if (single_state == ADC_BUSY && !(ADCSRA & BV(ADSC)))
+	{
+		ADC_result value;
+
+		value.bytes[0] = ADCL;              // ADCL must be read before ADCH
+		value.bytes[1] = ADCH;
+		PERF_COUNT (perf.conversions++);
+		sbi(ADCSRA, ADIF);                  // The ISR mustn't take it again
+		finish_single (value.word);
+	}
+	SREG = sreg;
+
+	if (single_state == ADC_BUSY && ++single_polls > ADC_RETRIES)
+	{
+		cbi(ADCSRA, ADIE);
+		mode = ADC_IDLE;
+		single_state = ADC_TIMEOUT;
+		timeout_count++;
+	}
+
+	return (single_state);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method checks whether the result of a reading begun with start() is ready. 
+ *  \return True if result() will return a good reading
+ */
+
+bool avr_adc::ready (void)
+{
+	return (poll () == ADC_READY);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the result of a reading begun with start(). 
+ *  \return The reading, or 0xFFFF if it isn't ready or timed out
+ */
+
+unsigned int avr_adc::result (void)
+{
+	if (single_state != ADC_READY)
+		return (0xFFFF);
+
+	return (single_result);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets a function to be called by the A/D interrupt routine whenever a
+ *  reading begun with start() is finished. The function runs with interrupts off, so
+ *  it should just save the result or set a flag and return. 
+ *  \param  function The function to call, or NULL for none
+ *  \param  p_data A pointer which is given to the function each time it's called
+ */
+
+void avr_adc::set_callback (adc_callback function, void* p_data)
+{
+	unsigned char sreg = SREG;              // The pointers are two bytes each, so the
+	cli ();                                 // ISR mustn't see them half changed
+	callback = function;
+	p_callback_data = p_data;
+	SREG = sreg;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the number of readings begun with start(), or taken with
+ *  read_once(), which were given up on because the converter took too long. 
+ *  \return The number of timeouts since the object was made
+ */
+
+unsigned int avr_adc::timeouts (void)
+{
+	return (timeout_count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method takes one reading for the status report, by polling with the A/D
+ *  interrupt off. The reading isn't given to the channel's filter or thresholds, or
+ *  stamped, or counted, and nothing about a scan or stream set up earlier is changed,
+ *  so the report doesn't disturb what the program sees. It's only used while the
+ *  converter is idle. 
+ *  \param  channel The A/D channel which is to be read, from 0 to 7
+ *  \return The reading, or 0xFFFF if the converter took too long
+ */
+
+unsigned int avr_adc::read_quietly (unsigned char channel)
+{
+	ADC_result value;
+	unsigned int tries;
+
+	// A one-shot scan may have left a conversion running; its ISR throws it away
+	for (tries = 0; (ADCSRA & BV(ADSC)) && tries < ADC_RETRIES; tries++);
+	ADCSRA &= ~BV(ADIE);
+
+	ADMUX = ((ADMUX & 0b11100000) | (channel & 0x07));
+	ADCSRA |= (BV(ADIF) | BV(ADSC));
+	for (tries = 0; (ADCSRA & BV(ADSC)) && tries < ADC_RETRIES; tries++);
+	if (ADCSRA & BV(ADSC))
+		return (0xFFFF);
+
+	value.bytes[0] = ADCL;                  // ADCL must be read before ADCH
+	value.bytes[1] = ADCH;
+	sbi(ADCSRA, ADIF);
+
+	return (value.word);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method tells whether the converter is taking a reading, streaming, capturing
+ *  blocks, or scanning. Anything which starts the converter doing something else
+ *  stops that, so code which only wants a look, like the << operator, checks first. 
+ *  \return True if the converter is in use, false if it's idle
+ */
+
+bool avr_adc::busy (void)
+{
+	return (mode != ADC_IDLE);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method stores the result of a reading begun with start(), turns off the A/D
+ *  interrupt, and calls the callback function. It's called by the ISR, or by poll()
+ *  with interrupts off. 
+ *  \param  value The reading
+ */
+
+void avr_adc::finish_single (unsigned int value)
+{
+	#ifdef ADC_TIMESTAMPS
+		if (stamping)
+			record_stamp (TCNT3);
+	#endif
+
+	new_sample (sample_channel, value);
+	single_result = value;
+	single_state = ADC_READY;
+	ADCSRA &= ~BV(ADIE);
+	mode = ADC_IDLE;
+
+	if (callback != NULL)
+		callback (value, p_callback_data);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method takes one A/D reading from the given channel and converts it to a
+ *  voltage in millivolts. The conversion uses ADC_VREF_MV as the reference voltage. 
+ *  \param  channel The A/D channel which is being read must be from 0 to 7
+ *  \return The voltage on the channel in millivolts
+ */
+
+unsigned int avr_adc::read_millivolts (unsigned char channel)
+{
+	return (adc_to_millivolts::convert (read_once (channel)));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts the A/D converter running freely on one channel. Each result is
+ *  picked up by the conversion complete interrupt and put in the ring buffer, so the
+ *  converter runs at its full rate, or at the rate given to set_sample_rate(), while
+ *  the CPU does other things. Interrupts must be globally enabled with sei() for this
+ *  to work. 
+ *  \param  channel The A/D channel which is to be read, from 0 to 7
+ */
+
+void avr_adc::start_streaming (unsigned char channel)
+{
+	stop ();
+
+	buffer_head = 0;
+	buffer_tail = 0;
+	clear_oversampling ();
+	sample_channel = channel & 0x07;
+	mode = ADC_STREAMING;
+
+	ADMUX = ((ADMUX & 0b11100000) | (channel & 0x1F));
+
+	start_conversions ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method stops free running conversions and returns the A/D to single sample
+ *  mode. Samples already in the ring buffer can still be read afterwards. 
+ */
+
+void avr_adc::stop (void)
+{
+	// Turn off free running, the timer and interrupts, then let any conversion which
+	// is under way finish so that it doesn't mess up the next one
+	ADCSRA &= ~(BV(ADIE) | BV(ADC_FREE_RUN));
+	stop_timer ();
+	for (unsigned int tries = 0; (ADCSRA & BV(ADSC)) && tries < ADC_RETRIES; tries++);
+
+	sbi(ADCSRA, ADIF);                      // Writing a one clears the interrupt flag
+	if (single_state == ADC_BUSY)
+		single_state = ADC_NO_RESULT;
+
+	// When a run is cut short, the time until the first sample of whatever runs next
+	// isn't an interval; after a reading or scan which finished by itself, it is
+	#ifdef ADC_TIMESTAMPS
+		if (mode != ADC_IDLE)
+			stamp_primed = false;
+	#endif
+	mode = ADC_IDLE;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finds how many samples are waiting in the ring buffer. 
+ *  \return The number of samples which can be read with read_samples()
+ */
+
+unsigned char avr_adc::samples_available (void)
+{
+	return ((buffer_head - buffer_tail) & (ADC_BUFFER_SIZE - 1));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method copies samples out of the ring buffer, oldest first. Only the ISR 
+ *  changes the head index and only this method changes the tail, and each is a single
+ *  byte, so no interrupts need to be turned off while copying. 
+ *  \param  dest Pointer to an array into which the samples are copied
+ *  \param  max_count The largest number of samples which will fit in the array
+ *  \return The number of samples which were copied
+ */
+
+unsigned char avr_adc::read_samples (unsigned int* dest, unsigned char max_count)
+{
+	unsigned char count = 0;
+	unsigned char tail = buffer_tail;
+	unsigned char head = buffer_head;
+
+	while (tail != head && count < max_count)
+	{
+		dest[count++] = sample_buffer[tail];
+		tail = (tail + 1) & (ADC_BUFFER_SIZE - 1);
+	}
+	buffer_tail = tail;
+
+	return (count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the number of samples which have been lost because the ring
+ *  buffer or both capture blocks were full when they arrived. If this number grows,
+ *  read the samples more often or make ADC_BUFFER_SIZE or ADC_BLOCK_SIZE bigger. 
+ *  \return The number of samples thrown away since the object was made
+ */
+
+unsigned int avr_adc::overruns (void)
+{
+	unsigned char sreg = SREG;              // The count is two bytes, so make sure
+	cli ();                                 // the ISR can't change it half way
+	unsigned int count = buffer_overruns;
+	SREG = sreg;
+
+	return (count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts capturing samples from one channel in blocks. The converter 
+ *  runs freely and the ISR fills one of two blocks; when it's full, the ISR hands it 
+ *  over to the user and goes on filling the other one. The user gets a pointer to the
+ *  full block from get_block(), reads or sends it in place, and gives it back with 
+ *  release_block(). The ISR never writes to a block the user holds, so a block is 
+ *  never torn; if the user holds one for so long that the other fills up, new samples
+ *  are thrown away and counted as overruns until it's given back. 
+ *  \param  channel The A/D channel which is to be read, from 0 to 7
+ */
+
+void avr_adc::start_blocks (unsigned char channel)
+{
+	stop ();
+
+	block_filling = 0;
+	block_fill_count = 0;
+	block_ready = ADC_NO_BLOCK;
+	clear_oversampling ();
+	sample_channel = channel & 0x07;
+	mode = ADC_BLOCKS;
+
+	ADMUX = ((ADMUX & 0b11100000) | (channel & 0x1F));
+	start_conversions ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finds the block of samples which is ready to be read, if there is one.
+ *  The same block is returned each time until release_block() is called. Once the 
+ *  capture has been stopped, a partly filled last block is handed over here too. 
+ *  \param  length A reference to a variable which is set to the number of samples 
+ *          in the block
+ *  \return A pointer to the first sample in the block, or NULL if none is ready
+ */
+
+const unsigned int* avr_adc::get_block (unsigned char& length)
+{
+	if (block_ready == ADC_NO_BLOCK && mode != ADC_BLOCKS && block_fill_count > 0)
+		hand_over_block ();
+
+	unsigned char ready = block_ready;
+
+	if (ready == ADC_NO_BLOCK)
+		return (NULL);
+
+	length = block_length[ready];
+	return (sample_blocks[ready]);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method gives the block which was read back to the ISR so that it can be 
+ *  filled again. Pointers from get_block() must not be used after this is called. 
+ */
+
+void avr_adc::release_block (void)
+{
+	block_ready = ADC_NO_BLOCK;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method hands the block which is being filled over to the user and makes the
+ *  other block the one to be filled. It's called by the ISR, or by get_block() when
+ *  the converter has been stopped, and only when the user isn't holding a block. 
+ */
+
+void avr_adc::hand_over_block (void)
+{
+	block_length[block_filling] = block_fill_count;
+	block_ready = block_filling;
+	block_filling ^= 1;
+	block_fill_count = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts a scan of several channels. The converter runs freely, and the
+ *  ISR sets up the multiplexer for the next channel while the current conversion runs.
+ *  In free running mode a new conversion starts as soon as one finishes, so each
+ *  multiplexer change takes effect one conversion later; the first channel is simply 
+ *  converted twice at startup to fill that pipeline. If a sample rate has been set,
+ *  the timer starts each conversion instead, and there's time to change channels in
+ *  between, so there's no pipeline; the rate is then conversions per second, so the
+ *  frames come at that rate divided by the number of channels. When a frame with one result from
+ *  each channel has been written, frame_ready() returns true; the ISR then leaves the
+ *  array alone until next_frame() is called, so a frame is never half old, half new. 
+ *  \param  channel_mask A bitmask with a one for each channel to be scanned
+ *  \param  dest An array with room for one result per channel; the results are put
+ *          in order of channel number, lowest first
+ *  \param  continuous True to keep scanning frames, false to stop after one frame
+ *  \return True if scanning started, false if no channels were given
+ */
+
+bool avr_adc::start_scan (unsigned char channel_mask, unsigned int* dest, 
+						  bool continuous)
+{
+	stop ();
+
+	scan_count = 0;
+	for (unsigned char channel = 0; channel < 8; channel++)
+		if (channel_mask & BV(channel))
+			scan_channels[scan_count++] = channel;
+
+	if (scan_count == 0)
+		return (false);
+
+	scan_dest = dest;
+	scan_continuous = continuous;
+	scan_converting = 0;
+	scan_pending = 0;
+	scan_storing = true;
+	scan_frame_ready = false;
+	clear_oversampling ();
+	mode = ADC_SCANNING;
+
+	ADMUX = ((ADMUX & 0b11100000) | scan_channels[0]);
+	start_conversions ();
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method checks whether a complete frame of scan results is in the array which
+ *  was given to start_scan(). 
+ *  \return True if a full frame is ready to be used
+ */
+
+bool avr_adc::frame_ready (void)
+{
+	return (scan_frame_ready);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method tells the ISR that the user is done with the current frame, so the 
+ *  next one can be written into the array. The new frame starts with the first 
+ *  channel in the list. 
+ */
+
+void avr_adc::next_frame (void)
+{
+	scan_frame_ready = false;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets the rate at which streaming, block capture and scanning take
+ *  samples. Timer 1 is used in CTC mode to mark the time for each sample: on the
+ *  ATmega644 and ATmega324P its compare match starts the conversion by itself, and on
+ *  other chips its interrupt routine does. Either way the samples are evenly spaced,
+ *  however busy the CPU is. The fastest clock divider which lets the timer count a 
+ *  whole sample period is used, so the rate is as close as it can be to the one asked
+ *  for; achieved_rate() and rate_error_ppm() say how close. Any streaming or scanning
+ *  which is going on is stopped. 
+ *  \param  rate_hz The number of samples per second, or 0 to let the converter run
+ *          freely at its own rate again
+ *  \return True if the rate was set, false if it's faster than the converter can go
+ */
+
+bool avr_adc::set_sample_rate (unsigned int rate_hz)
+{
+	static const unsigned int dividers[] = { 1, 8, 64, 256, 1024 };
+
+	stop ();
+
+	timer_clock = 0;
+	rate_achieved = 0;
+	rate_error = 0;
+
+	if (rate_hz == 0)
+		return (true);
+	if (rate_hz > adc_config::CONVERSION_HZ)
+		return (false);
+
+	for (unsigned char index = 0; index < 5; index++)
+	{
+		// Timer counts per sample, rounded to the nearest count
+		unsigned long per_count = (unsigned long)dividers[index] * rate_hz;
+		unsigned long counts = (F_CPU + per_count / 2) / per_count;
+
+		if (counts <= 0x10000UL)
+		{
+			unsigned long period = counts * dividers[index];
+			unsigned long asked = period * rate_hz;
+
+			timer_clock = index + 1;
+			timer_top = (unsigned int)(counts - 1);
+			rate_achieved = (unsigned int)((F_CPU + period / 2) / period);
+
+			// The error is (F_CPU - asked) / asked; 1000000 is split into 15625 * 64
+			// so the numbers fit in 32 bits
+			rate_error = ((long)F_CPU - (long)asked) * 15625L / (long)(asked / 64);
+			return (true);
+		}
+	}
+
+	return (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method says what sample rate the timer really gives, which can differ a bit 
+ *  from the one asked for because the timer counts whole clock cycles. 
+ *  \return The sample rate in Hz, rounded, or 0 if the converter is free running
+ */
+
+unsigned int avr_adc::achieved_rate (void)
+{
+	return (rate_achieved);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method says how far the timer's sample rate is from the one asked for. 
+ *  \return The error in parts per million; it's positive if the rate is too fast
+ */
+
+long avr_adc::rate_error_ppm (void)
+{
+	return (rate_error);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts conversions going for streaming, block capture or scanning. 
+ *  Without a sample rate the converter is put in free running mode and the first
+ *  conversion is started; the rest follow by themselves. With a sample rate, Timer 1
+ *  is started in CTC mode, counting from 0 to timer_top, and each compare match
+ *  starts a conversion, either directly or through the Timer 1 interrupt. 
+ */
+
+void avr_adc::start_conversions (void)
+{
+	if (timer_clock == 0)
+	{
+		#ifdef ADC_HW_TRIGGER
+			ADCSRB &= ~(BV(ADTS2) | BV(ADTS1) | BV(ADTS0));
+		#endif
+		ADCSRA |= (BV(ADIE) | BV(ADC_FREE_RUN) | BV(ADSC));
+		return;
+	}
+
+	TCCR1B = 0;                             // Stop the timer while setting it up
+	TCCR1A = 0;
+	TCNT1 = 0;
+	OCR1A = timer_top;
+
+	#ifdef ADC_HW_TRIGGER
+		// Compare match B is the trigger; it's at the top, where A clears the count
+		OCR1B = timer_top;
+		TIFR1 = BV(OCF1B);
+		ADCSRB = (ADCSRB & ~(BV(ADTS2) | BV(ADTS1) | BV(ADTS0)))
+				 | BV(ADTS2) | BV(ADTS0);
+		ADCSRA |= (BV(ADIE) | BV(ADATE));
+	#else
+		TIFR = BV(OCF1A);
+		TIMSK |= BV(OCIE1A);
+		ADCSRA |= BV(ADIE);
+	#endif
+
+	TCCR1B = BV(WGM12) | timer_clock;       // CTC mode, and start counting
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method stops Timer 1 from starting conversions, if it was being used to. 
+ */
+
+void avr_adc::stop_timer (void)
+{
+	if (timer_clock == 0)
+		return;
+
+	TCCR1B = 0;
+	#ifdef ADC_HW_TRIGGER
+		ADCSRB &= ~(BV(ADTS2) | BV(ADTS1) | BV(ADTS0));
+	#else
+		TIMSK &= ~BV(OCIE1A);
+	#endif
+}
 
+
+//-------------------------------------------------------------------------------------
+/** This method is called by the Timer 1 compare match interrupt routine when it's
+ *  time for the next sample. If the last conversion somehow hasn't finished, this
+ *  sample can't be taken, and it's counted as an overrun. 
+ */
+
+void avr_adc::timer_trigger (void)
+{
+	if (ADCSRA & BV(ADSC))
+		buffer_overruns++;
+	else
+		ADCSRA |= BV(ADSC);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets up oversampling for streaming and scanning. Each result is made
+ *  by adding up 4^n conversions of a channel and shifting the sum right by n bits, 
+ *  which gives n more bits of resolution as long as the signal has a little noise on
+ *  it (Atmel's application note AVR121 explains why). The adding is done in the ISR,
+ *  so the main loop only hears about one result for every 4^n conversions. The 
+ *  results have 10 + n bits, so they should be converted to millivolts with 
+ *  adc_millivolts<ADC_VREF_MV, 10 + n>. Blocking read_once() readings aren't
+ *  oversampled. Any streaming or scanning which is going on is stopped. 
+ *  \param  extra_bits The number of extra bits n, from 0 (no oversampling) to
+ *          ADC_MAX_OVERSAMPLE
+ *  \return True if the setting was accepted, false if too many bits were asked for
+ */
+
+bool avr_adc::set_oversampling (unsigned char extra_bits)
+{
+	if (extra_bits > ADC_MAX_OVERSAMPLE)
+		return (false);
+
+	stop ();
+
+	oversample_bits = extra_bits;
+	oversample_ratio = 1 << (2 * extra_bits);
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method says how many bits are in each streaming or scanning result. 
+ *  \return The number of bits, 10 without oversampling and up to 14 with it
+ */
+
+unsigned char avr_adc::resolution (void)
+{
+	return (10 + oversample_bits);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method attaches a filter to a channel. From then on, the A/D interrupt gives
+ *  the filter each sample from that channel, whether it comes from streaming, 
+ *  scanning, block capture, or a single reading, after any oversampling. The samples
+ *  themselves still go where they would anyway. One filter shouldn't be attached to
+ *  two channels. 
+ *  \param  channel The A/D channel, from 0 to 7
+ *  \param  p_filter A pointer to the filter, or NULL to take the channel's filter off
+ */
+
+void avr_adc::attach_filter (unsigned char channel, adc_filter* p_filter)
+{
+	unsigned char sreg = SREG;              // The pointer is two bytes, so the ISR
+	cli ();                                 // mustn't see it half changed
+	p_filters[channel & 0x07] = p_filter;
+	SREG = sreg;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the filtered value for a channel. The filter has already done
+ *  its work as the samples came in, so this just reads its output. 
+ *  \param  channel The A/D channel, from 0 to 7
+ *  \return The filtered value, or 0xFFFF if the channel has no filter
+ */
+
+unsigned int avr_adc::filtered (unsigned char channel)
+{
+	adc_filter* p_filter = p_filters[channel & 0x07];
+
+	if (p_filter == NULL)
+		return (0xFFFF);
+
+	return (p_filter->value ());
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets low and high thresholds for a channel, making a window comparator.
+ *  From then on, each of the channel's samples is checked as it comes in, after the
+ *  channel's filter if it has one, and an event is queued only when the value moves
+ *  into a different zone. Hysteresis keeps a noisy value sitting on a threshold from
+ *  making a stream of events: once above the high threshold, the value must come back
+ *  down to more than the hysteresis below it to be normal again, and the same for low.
+ *  The first sample after the thresholds are set always makes an event, so the user
+ *  learns where the channel starts. 
+ *  \param  channel The A/D channel, from 0 to 7
+ *  \param  low The value below which the channel is low
+ *  \param  high The value above which the channel is high
+ *  \param  hysteresis How far back past a threshold the value must go to be normal
+ *  \return True if the thresholds were set, false if low is above high
+ */
+
+bool avr_adc::set_window (unsigned char channel, unsigned int low, unsigned int high,
+	unsigned int hysteresis)
+{
+	if (low > high)
+		return (false);
+
+	channel &= 0x07;
+	unsigned char sreg = SREG;              // The ISR mustn't use half a setting
+	cli ();
+	window_low[channel] = low;
+	window_high[channel] = high;
+	window_hysteresis[channel] = hysteresis;
+	window_zone[channel] = ADC_ZONE_UNKNOWN;
+	window_mask |= BV(channel);
+	SREG = sreg;
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method stops checking a channel's samples against its thresholds. Events
+ *  already in the queue stay there. 
+ *  \param  channel The A/D channel, from 0 to 7
+ */
+
+void avr_adc::clear_window (unsigned char channel)
+{
+	unsigned char sreg = SREG;
+	cli ();
+	window_mask &= ~BV(channel & 0x07);
+	window_zone[channel & 0x07] = ADC_ZONE_UNKNOWN;
+	SREG = sreg;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method tells which zone a channel's value was in when it was last checked. 
+ *  \param  channel The A/D channel, from 0 to 7
+ *  \return The zone, or ADC_ZONE_UNKNOWN if the channel has no thresholds or hasn't
+ *          been sampled since they were set
+ */
+
+adc_zone avr_adc::zone (unsigned char channel)
+{
+	return (window_zone[channel & 0x07]);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method takes the oldest threshold crossing event out of the queue. 
+ *  \param  event A reference to the structure into which the event is copied
+ *  \return True if there was an event, false if the queue was empty
+ */
+
+bool avr_adc::get_event (adc_event& event)
+{
+	if (event_tail == event_head)
+		return (false);
+
+	// The ISR only changes the head, so the event at the tail can be copied
+	event = events[event_tail];
+	event_tail = (event_tail + 1) & (ADC_EVENT_QUEUE - 1);
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the number of events which were thrown away because the queue
+ *  was full. 
+ *  \return The number of lost events
+ */
+
+unsigned int avr_adc::lost_events (void)
+{
+	unsigned char sreg = SREG;
+	cli ();
+	unsigned int count = events_lost;
+	SREG = sreg;
+
+	return (count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method is called by the ISR, or with interrupts off, for each finished sample.
+ *  It gives the sample to the channel's filter, if there is one, then checks the 
+ *  filtered value against the channel's thresholds, if it has them. When the value
+ *  has moved into a different zone, an event is put in the queue. 
+ *  \param  channel The channel from which the sample came
+ *  \param  value The sample
+ */
+
+void avr_adc::new_sample (unsigned char channel, unsigned int value)
+{
+	adc_filter* p_filter = p_filters[channel];
+
+	if (p_filter != NULL)
+	{
+		p_filter->update (value);
+		value = p_filter->value ();
+	}
+
+	if ((window_mask & BV(channel)) == 0)
+		return;
+
+	// Inside the window, a value only goes back to normal once it's more than the
+	// hysteresis away from the threshold it had crossed
+	adc_zone old_zone = window_zone[channel];
+	adc_zone new_zone = ADC_ZONE_NORMAL;
+
+	if (value > window_high[channel])
+		new_zone = ADC_ZONE_HIGH;
+	else if (value < window_low[channel])
+		new_zone = ADC_ZONE_LOW;
+	else if (old_zone == ADC_ZONE_HIGH
+			 && window_high[channel] - value <= window_hysteresis[channel])
+		new_zone = ADC_ZONE_HIGH;
+	else if (old_zone == ADC_ZONE_LOW
+			 && value - window_low[channel] <= window_hysteresis[channel])
+		new_zone = ADC_ZONE_LOW;
+
+	if (new_zone == old_zone)
+		return;
+
+	window_zone[channel] = new_zone;
+
+	unsigned char next = (event_head + 1) & (ADC_EVENT_QUEUE - 1);
+	if (next == event_tail)
+		events_lost++;
+	else
+	{
+		events[event_head].channel = channel;
+		events[event_head].zone = new_zone;
+		events[event_head].value = value;
+		event_head = next;
+	}
+}
+
+
+#ifdef ADC_TIMESTAMPS
+//-------------------------------------------------------------------------------------
+/** This method turns time stamps on or off. When they're on, Timer 3 counts freely,
+ *  one count for each ADC_STAMP_DIVIDER CPU clocks, and the A/D interrupt reads it as
+ *  each sample comes in, so the time a sample was taken is known to within the time
+ *  it took the interrupt to start, rather than whenever the main loop got to it. The
+ *  stamps wrap around every 65536 counts; the difference between two of them, taken
+ *  as an unsigned int, is right as long as they're less than that far apart. The
+ *  interval statistics are cleared. 
+ *  \param  on True to stamp samples, false to stop the timer and stop stamping
+ */
+
+void avr_adc::use_timestamps (bool on)
+{
+	unsigned char sreg = SREG;
+	cli ();
+	if (on)
+	{
+		TCCR3A = 0;                         // Normal mode, counting up to 0xFFFF
+		TCCR3B = ADC_STAMP_CLOCK;
+	}
+	else
+		TCCR3B = 0;
+	stamping = on;
+	SREG = sreg;
+
+	clear_intervals ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the time stamp of the most recent sample, such as the reading
+ *  just taken by read_once() or start(). 
+ *  \return The count of the time stamp timer when the sample came in
+ */
+
+unsigned int avr_adc::stamp (void)
+{
+	unsigned char sreg = SREG;
+	cli ();
+	unsigned int copy = last_stamp;
+	SREG = sreg;
+
+	return (copy);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the time stamp of the frame which frame_ready() says is ready,
+ *  which is the time its first channel was converted. The other channels came after
+ *  it, one conversion time apart. 
+ *  \return The count of the time stamp timer when the frame's first sample came in
+ */
+
+unsigned int avr_adc::frame_stamp (void)
+{
+	unsigned char sreg = SREG;
+	cli ();
+	unsigned int copy = scan_stamp;
+	SREG = sreg;
+
+	return (copy);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method copies samples out of the ring buffer, oldest first, along with the
+ *  time stamp of each one. 
+ *  \param  dest Pointer to an array into which the samples are copied
+ *  \param  stamps Pointer to an array into which the time stamps are copied
+ *  \param  max_count The largest number of samples which will fit in the arrays
+ *  \return The number of samples which were copied
+ */
+
+unsigned char avr_adc::read_samples (unsigned int* dest, unsigned int* stamps,
+	unsigned char max_count)
+{
+	unsigned char count = 0;
+	unsigned char tail = buffer_tail;
+	unsigned char head = buffer_head;
+
+	while (tail != head && count < max_count)
+	{
+		stamps[count] = stamp_buffer[tail];
+		dest[count++] = sample_buffer[tail];
+		tail = (tail + 1) & (ADC_BUFFER_SIZE - 1);
+	}
+	buffer_tail = tail;
+
+	return (count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method copies the statistics about the time between samples. Interrupts are
+ *  held off so that the ISR can't change them half way through. 
+ *  \param  copy A reference to the structure into which the statistics are copied
+ */
+
+void avr_adc::get_intervals (adc_intervals& copy)
+{
+	unsigned char sreg = SREG;
+	cli ();
+	copy.shortest = intervals.shortest;
+	copy.longest = intervals.longest;
+	copy.total = intervals.total;
+	copy.count = intervals.count;
+	SREG = sreg;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method clears the statistics about the time between samples. The time from
+ *  the last sample to the next isn't counted either. 
+ */
+
+void avr_adc::clear_intervals (void)
+{
+	unsigned char sreg = SREG;
+	cli ();
+	stamp_primed = false;
+	intervals.shortest = 0xFFFF;
+	intervals.longest = 0;
+	intervals.total = 0;
+	intervals.count = 0;
+	SREG = sreg;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method is called by the ISR, or with interrupts off, for each finished sample
+ *  while time stamps are on. It saves the stamp and adds the time since the last one
+ *  to the statistics. In a scan, it's only called for the first channel. 
+ *  \param  now The count of the time stamp timer when the sample came in
+ */
+
+void avr_adc::record_stamp (unsigned int now)
+{
+	if (stamp_primed)
+	{
+		unsigned int interval = (uint16_t)(now - last_stamp);  // Wraps at 16 bits
+
+		if (interval < intervals.shortest)
+			intervals.shortest = interval;
+		if (interval > intervals.longest)
+			intervals.longest = interval;
+		intervals.total += interval;
+		intervals.count++;
+	}
+
+	last_stamp = now;
+	stamp_primed = true;
+}
+#endif // ADC_TIMESTAMPS
+
+
+//-------------------------------------------------------------------------------------
+/** This method empties the oversampling sums, so that the first result of a new 
+ *  stream or scan doesn't include conversions left over from the last one. It's
+ *  only called while the converter is stopped, so the ISR won't be using the sums. 
+ */
+
+void avr_adc::clear_oversampling (void)
+{
+	for (unsigned char index = 0; index < 8; index++)
+	{
+		oversample_sum[index] = 0;
+		oversample_count[index] = 0;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method is called by the interrupt service routine each time a conversion has
+ *  finished. It reads the result and works out which place in the scan list it came
+ *  from. If oversampling is on, the result is added to that place's sum, and nothing
+ *  else happens until enough conversions have been added up. Each finished result is
+ *  then put in the ring buffer, unless the buffer is full, in which case the sample is
+ *  counted as an overrun and dropped, or in the block being filled, or in the frame of
+ *  scan results. The result is also given to the channel's filter and thresholds, and
+ *  if time stamps are on, it's stamped with the time at which this routine began.
+ */
+
+void avr_adc::conversion_complete (void)
+{
 	ADC_result result;
+	unsigned char index = 0;
 
-	while(ADCSRA & 0b01000000); // wait for conversion to complete (bit 6 will change to 0)
-	result.bytes[0] = ADCL;
+	result.bytes[0] = ADCL;                 // ADCL must be read before ADCH
 	result.bytes[1] = ADCH;
+	PERF_COUNT (perf.conversions++);
+
+	if (mode == ADC_SINGLE)
+	{
+		finish_single (result.word);
+		return;
+	}
+
+	// The time is read as soon as possible, so that it's close to the conversion's end
+	#ifdef ADC_TIMESTAMPS
+		unsigned int now = stamping ? TCNT3 : 0;
+	#endif
+
+	#ifdef ADC_HW_TRIGGER
+		// The compare match flag must be cleared or the next match won't trigger
+		if (timer_clock != 0)
+			TIFR1 = BV(OCF1B);
+	#endif
+
+	if (mode == ADC_SCANNING)
+	{
+		index = scan_converting;
+
+		if (timer_clock != 0)
+		{
+			// Nothing is converting until the timer says so; set up the next channel
+			if (++scan_converting >= scan_count)
+				scan_converting = 0;
+			ADMUX = ((ADMUX & 0b11100000) | scan_channels[scan_converting]);
+		}
+		else
+		{
+			// The conversion which just started uses the channel set up last time,
+			// so set up the one after it
+			scan_converting = scan_pending;
+			if (++scan_pending >= scan_count)
+				scan_pending = 0;
+			ADMUX = ((ADMUX & 0b11100000) | scan_channels[scan_pending]);
+		}
+	}
+	else if (mode == ADC_IDLE)
+	{
+		// This is the conversion a one-shot scan left running; throw it away
+		ADCSRA &= ~BV(ADIE);
+		return;
+	}
+
+	// When oversampling, add up conversions until there are enough for one result
+	if (oversample_bits != 0)
+	{
+		oversample_sum[index] += result.word;
+		if (++oversample_count[index] < oversample_ratio)
+			return;
+
+		result.word = (uint16_t)(oversample_sum[index] >> oversample_bits);
+		oversample_sum[index] = 0;
+		oversample_count[index] = 0;
+	}
+
+	// A scan is stamped by its first sample, so its intervals are from scan to scan
+	#ifdef ADC_TIMESTAMPS
+		if (stamping && (mode != ADC_SCANNING || index == 0))
+			record_stamp (now);
+	#endif
+
+	// ADMUX may already have moved on to the next channel, so it isn't read back
+	new_sample ((mode == ADC_SCANNING) ? scan_channels[index] : sample_channel,
+	            result.word);
+
+	if (mode == ADC_STREAMING)
+	{
+		unsigned char next = (buffer_head + 1) & (ADC_BUFFER_SIZE - 1);
+
+		if (next == buffer_tail)
+			buffer_overruns++;
+		else
+		{
+			sample_buffer[buffer_head] = result.word;
+			#ifdef ADC_TIMESTAMPS
+				stamp_buffer[buffer_head] = last_stamp;
+			#endif
+			buffer_head = next;
+		}
+	}
+	else if (mode == ADC_BLOCKS)
+	{
+		// A full block waits until the user gives the other one back
+		if (block_fill_count >= ADC_BLOCK_SIZE)
+		{
+			if (block_ready != ADC_NO_BLOCK)
+			{
+				buffer_overruns++;
+				return;
+			}
+			hand_over_block ();
+		}
+
+		sample_blocks[block_filling][block_fill_count++] = result.word;
+
+		if (block_fill_count >= ADC_BLOCK_SIZE && block_ready == ADC_NO_BLOCK)
+			hand_over_block ();
+	}
+	else
+	{
+		// A new frame begins only once the user is done with the last one
+		if (index == 0 && !scan_frame_ready)
+			scan_storing = true;
+
+		if (scan_storing)
+		{
+			scan_dest[index] = result.word;
+			#ifdef ADC_TIMESTAMPS
+				if (index == 0)
+					scan_stamp = last_stamp;
+			#endif
+
+			if (index == scan_count - 1)
+			{
+				scan_storing = false;
+				scan_frame_ready = true;
+
+				// When free running, the next conversion has already begun and
+				// can't be stopped, so the interrupt is left on to throw it away
+				if (!scan_continuous)
+				{
+					if (timer_clock != 0)
+					{
+						ADCSRA &= ~(BV(ADIE) | BV(ADC_FREE_RUN));
+						stop_timer ();
+					}
+					else
+						ADCSRA &= ~BV(ADC_FREE_RUN);
+					mode = ADC_IDLE;
+				}
+			}
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This is the A/D conversion complete interrupt service routine. It just hands the
+ *  work to the A/D object. 
+ */
 
-	return result.word;
+ISR (ADC_vect)
+{
+	if (p_isr_adc != NULL)
+		p_isr_adc->conversion_complete ();
+}
+
+
+#ifndef ADC_HW_TRIGGER
+//-------------------------------------------------------------------------------------
+/** This is the Timer 1 compare match interrupt service routine, which starts timed
+ *  conversions on chips which can't start them from the timer by themselves. 
+ */
+
+ISR (TIMER1_COMPA_vect)
+{
+	if (p_isr_adc != NULL)
+		p_isr_adc->timer_trigger ();
+}
+#endif
+
+//-------------------------------------------------------------------------------------
+/** This operator prints a threshold crossing event as the channel number, the zone it
+ *  moved into, and the value which moved it there, such as "ch2 high 812". Printing
+ *  only the events, rather than every channel every time, makes the amount of text
+ *  depend on how much the inputs are changing rather than on how often they're read.
+ *  @param serial A reference to the serial-type object to which to print
+ *  @param event A reference to the event, from avr_adc::get_event()
+ */
+
+base_text_serial& operator<< (base_text_serial& serial, const adc_event& event)
+{
+	// The names are in program memory, each in a space as long as the longest
+	static const char names[][7] PROGMEM = { "?", "low", "normal", "high" };
+
+	serial << FLASH_STR ("ch") << event.channel << FLASH_STR (" ")
+		<< reinterpret_cast<const flash_string*> (names[event.zone]) << FLASH_STR (" ")
+		<< event.value;
+
+	return (serial);
+}
+
+
+#ifdef ADC_TIMESTAMPS
+//-------------------------------------------------------------------------------------
+/** This operator prints the statistics about the time between samples, converted from
+ *  timer counts into microseconds. 
+ *  @param serial A reference to the serial-type object to which to print
+ *  @param stats A reference to the statistics, from avr_adc::get_intervals()
+ */
+
+base_text_serial& operator<< (base_text_serial& serial, const adc_intervals& stats)
+{
+	const unsigned long per_us = F_CPU / 1000000UL;
+
+	if (stats.count == 0)
+		return (serial << FLASH_STR ("Sample interval: none") << endl);
+
+	unsigned long mean = stats.total / stats.count;
+
+	serial << FLASH_STR ("Sample interval us min: ")
+		<< (unsigned long)stats.shortest * ADC_STAMP_DIVIDER / per_us
+		<< FLASH_STR (" mean: ") << mean * ADC_STAMP_DIVIDER / per_us
+		<< FLASH_STR (" max: ")
+		<< (unsigned long)stats.longest * ADC_STAMP_DIVIDER / per_us
+		<< FLASH_STR (" (") << stats.count << FLASH_STR (")") << endl;
+
+	return (serial);
 }
+#endif // ADC_TIMESTAMPS
+
+
+#ifdef PERF_COUNTERS
+//-------------------------------------------------------------------------------------
+/** This method copies the performance counters. Interrupts are held off while they're
+ *  copied so that the ISR can't change them half way through. 
+ *  \param  copy A reference to the structure into which the counters are copied
+ */
+
+void avr_adc::get_counters (adc_counters& copy)
+{
+	unsigned char sreg = SREG;
+	cli ();
+	copy.conversions = perf.conversions;
+	copy.wait_total = perf.wait_total;
+	copy.wait_max = perf.wait_max;
+	copy.waited = perf.waited;
+	SREG = sreg;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets all the performance counters back to zero. 
+ */
+
+void avr_adc::clear_counters (void)
+{
+	unsigned char sreg = SREG;
+	cli ();
+	perf.conversions = 0;
+	perf.wait_total = 0;
+	perf.wait_max = 0;
+	perf.waited = 0;
+	SREG = sreg;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This operator prints the A/D performance counters on a serial device. The average
+ *  wait is worked out here, so the drivers only have to add. 
+ *  @param serial A reference to the serial-type object to which to print
+ *  @param counters A reference to the counters, from avr_adc::get_counters()
+ */
+
+base_text_serial& operator<< (base_text_serial& serial, const adc_counters& counters)
+{
+	unsigned long average = 0;
+
+	if (counters.waited != 0)
+		average = counters.wait_total / counters.waited;
+
+	serial << FLASH_STR ("A/D conversions: ") << counters.conversions << endl
+		<< FLASH_STR ("Wait loops average: ") << average << FLASH_STR (" max: ")
+		<< counters.wait_max << endl;
+
+	return (serial);
+}
+#endif // PERF_COUNTERS
+
 
 //--------------------------------------------------------------------------------------
 /** This overloaded operator allows information about or from an A/D converter to be 
  *  printed on a serial device such as a regular serial port or radio module in text 
  *  mode, which is extremely convenient for debugging. It outputs a list of all available
- *  channels along with their respective voltages, in millivolts.
+ *  channels along with their respective voltages, in millivolts. If the converter is
+ *  idle, each channel is read without its filter, thresholds or time stamps seeing the
+ *  reading; if it's busy, stopping it would spoil whatever the program has it doing, so
+ *  the channels' filtered values are printed instead. 
  *  @param serial A reference to the serial-type object to which to print
- *  @param stamp A reference to the time stamp to be displayed
+ *  @param my_adc A reference to the A/D converter
  */
 
 base_text_serial& operator<< (base_text_serial& serial, avr_adc& my_adc)
 {
-	unsigned int channel0, channel1, channel2, channel3;
-	unsigned long vchannel0, vchannel1, vchannel2, vchannel3;
-
-	// Gets values for all the available channels
-	channel0 = my_adc.read_once(0);
-	channel1 = my_adc.read_once(1);
-	channel2 = my_adc.read_once(2);
-	channel3 = my_adc.read_once(3);
-
-	// Converts to millivolts
-	vchannel0 = (unsigned long)channel0 * 5000 / 1024;
-	vchannel1 = (unsigned long)channel1 * 5000 / 1024;
-	vchannel2 = (unsigned long)channel2 * 5000 / 1024;
-	vchannel3 = (unsigned long)channel3 * 5000 / 1024;
-
-
-	// Outputs to the serial port
-	serial  << 	"A/D registers of interest:" << endl << 
-		"ADMUX: " << ADMUX << endl << 
-		"ADCSRA: " << ADCSRA << endl << 
-		"Current value of channels:" << endl <<
-		"Channel 0: " << channel0 << "   in MilliVolt: " << vchannel0 << endl <<
-		"Channel 1: " << channel1 << "   in MilliVolt: " << vchannel1 << endl <<
-		"Channel 2: " << channel2 << "   in MilliVolt: " << vchannel2 << endl << 
-		"Channel 3: " << channel3 << "   in MilliVolt: " << vchannel3 << endl << endl << endl;
+	unsigned int values[4];
+	unsigned char extra_bits = 0;
+	bool busy = my_adc.busy ();
+
+	// Filtered values have as many bits as the oversampling gives; readings have 10
+	for (unsigned char channel = 0; channel < 4; channel++)
+		if (busy)
+			values[channel] = my_adc.filtered (channel);
+		else
+			values[channel] = my_adc.read_quietly (channel);
+	if (busy)
+		extra_bits = my_adc.resolution () - 10;
+
+	// Outputs to the serial port; the text is read straight from program memory
+	serial  << 	FLASH_STR ("A/D registers of interest:") << endl << 
+		FLASH_STR ("ADMUX: ") << ADMUX << endl << 
+		FLASH_STR ("ADCSRA: ") << ADCSRA << endl;
+	if (busy)
+		serial << FLASH_STR ("Converter busy; filtered value of channels:") << endl;
+	else
+		serial << FLASH_STR ("Current value of channels:") << endl;
+
+	// Converts to millivolts, dropping any extra bits from oversampling first
+	for (unsigned char channel = 0; channel < 4; channel++)
+	{
+		serial << FLASH_STR ("Channel ") << channel << FLASH_STR (": ");
+		if (values[channel] != 0xFFFF)
+			serial << values[channel] << FLASH_STR ("   in MilliVolt: ")
+				<< adc_to_millivolts::convert (values[channel] >> extra_bits) << endl;
+		else if (busy)
+			serial << FLASH_STR ("no filter") << endl;
+		else
+			serial << FLASH_STR ("timeout") << endl;
+	}
+	#ifdef ADC_TIMESTAMPS
+		adc_intervals stats;
+		my_adc.get_intervals (stats);
+		if (stats.count != 0)
+			serial << stats;
+	#endif
+	serial << endl << endl;
 
 	return (serial);
 }
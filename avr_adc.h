@@ -14,6 +14,171 @@
 #ifndef _AVR_ADC_H_                         // To prevent *.h file from being included
 #define _AVR_ADC_H_                         // in a source file more than once
 
+#include "adc_convert.h"                    // Template for converting to millivolts
+#include "adc_clock.h"                      // Template for setting the A/D clock
+#include "perf_counters.h"                  // Optional performance counters
+#include "adc_filter.h"                     // Filters which smooth each channel
+#include "binary_frame.h"                   // For the size of a block frame
+
+
+//-------------------------------------------------------------------------------------
+// The bit which makes the A/D free running is called ADFR on the ATmega128, while the
+// newer chips call it ADATE and pick free running mode with the ADTS bits in ADCSRB
+
+#ifdef __AVR_ATmega128__
+    #define ADC_FREE_RUN    ADFR            // Free running select bit in ADCSRA
+#else
+    #define ADC_FREE_RUN    ADATE           // Auto trigger enable bit in ADCSRA
+#endif
+
+// The ATmega644 and ATmega324P can start conversions on a Timer 1 compare match by
+// themselves; on the others, a Timer 1 interrupt routine has to start each one
+#if defined __AVR_ATmega644__ || defined __AVR_ATmega324P__
+    #define ADC_HW_TRIGGER                  // ADTS bits can pick a timer trigger
+#endif
+
+// The ATmega128 has a second 16-bit timer, Timer 3, which can count freely to time
+// stamp samples while Timer 1 times the conversions
+#ifdef __AVR_ATmega128__
+    #define ADC_TIMESTAMPS                  // Samples can be time stamped
+#endif
+
+#ifndef F_CPU
+    #error F_CPU must be set to the CPU clock frequency, for example in the Makefile
+#endif
+
+/** This is the number of bits which must be good in each reading. It sets how fast
+ *  the A/D clock can be run; 10 gives full accuracy, 8 gives the quickest conversions
+ */
+#ifndef ADC_RESOLUTION
+    #define ADC_RESOLUTION  10
+#endif
+
+/// This type holds the A/D clock settings, worked out for F_CPU by the compiler
+typedef adc_clock<F_CPU, ADC_RESOLUTION> adc_config;
+
+#ifdef ADC_TIMESTAMPS
+    /** This is how many CPU clocks make one count of the time stamp timer. With 8, a
+     *  count is a microsecond at 8 MHz, and intervals of up to 65 ms can be measured
+     */
+    #ifndef ADC_STAMP_DIVIDER
+        #define ADC_STAMP_DIVIDER   8
+    #endif
+
+    /// This is the Timer 3 clock select setting which gives ADC_STAMP_DIVIDER
+    #if ADC_STAMP_DIVIDER == 1
+        #define ADC_STAMP_CLOCK     1
+    #elif ADC_STAMP_DIVIDER == 8
+        #define ADC_STAMP_CLOCK     2
+    #elif ADC_STAMP_DIVIDER == 64
+        #define ADC_STAMP_CLOCK     3
+    #elif ADC_STAMP_DIVIDER == 256
+        #define ADC_STAMP_CLOCK     4
+    #elif ADC_STAMP_DIVIDER == 1024
+        #define ADC_STAMP_CLOCK     5
+    #else
+        #error ADC_STAMP_DIVIDER must be 1, 8, 64, 256 or 1024
+    #endif
+#endif
+
+/** This is the number of samples which the ring buffer can hold in streaming mode. It
+ *  must be a power of two no bigger than 128 so that the indices wrap with a mask
+ */
+#define ADC_BUFFER_SIZE     32
+
+/** This is the number of samples in each of the two blocks used for block capture. A
+ *  block must fit in one binary frame with its 5 bytes of header, so it can't be more
+ *  than 47 samples of 10 bits, or 33 samples at the 14 bits of full oversampling
+ */
+#define ADC_BLOCK_SIZE      32
+
+/// This block number means that no block is waiting to be read
+#define ADC_NO_BLOCK        0xFF
+
+/** This is the most extra bits of resolution which oversampling can give. Each extra
+ *  bit takes four times as many conversions, so 4 bits means 256 conversions per
+ *  result, and 14-bit results are the most the accumulators are sized for
+ */
+#define ADC_MAX_OVERSAMPLE  4
+
+/** This is the number of threshold crossing events which can wait to be read. It
+ *  must be a power of two no bigger than 128 so that the indices wrap with a mask
+ */
+#define ADC_EVENT_QUEUE     8
+
+/// This is the A/D reference voltage in millivolts; AVCC is used as the reference
+#define ADC_VREF_MV         5000
+
+/// This type converts readings as the A/D is set up here: right adjusted, 10 bits
+typedef adc_millivolts<ADC_VREF_MV, 10, false> adc_to_millivolts;
+
+
+//-------------------------------------------------------------------------------------
+/** This enumeration lists the things the A/D converter can be busy doing. 
+ */
+
+typedef enum {
+    ADC_IDLE,               ///< Not converting
+    ADC_SINGLE,             ///< Taking one reading, by start() or read_once()
+    ADC_STREAMING,          ///< Free running, with results put in the ring buffer
+    ADC_SCANNING,           ///< Free running through a list of channels, frame by frame
+    ADC_BLOCKS              ///< Free running, with results put in two blocks in turn
+    } adc_mode;
+
+
+//-------------------------------------------------------------------------------------
+/** This enumeration lists what can have happened to a reading begun with start().
+ */
+
+typedef enum {
+    ADC_BUSY,               ///< The conversion hasn't finished yet
+    ADC_READY,              ///< The result is ready to be picked up
+    ADC_TIMEOUT,            ///< The conversion took too long and was given up on
+    ADC_NO_RESULT           ///< No reading was started, or it was stopped
+    } adc_status;
+
+/** This type of function can be called by the A/D interrupt when a reading begun with
+ *  start() is done. It's given the result and the pointer given to set_callback().
+ *  Since it runs in the interrupt routine, it must be quick.
+ */
+typedef void (*adc_callback) (unsigned int, void*);
+
+
+//-------------------------------------------------------------------------------------
+/** This enumeration lists where a channel's value is compared to its thresholds.
+ */
+
+typedef enum {
+    ADC_ZONE_UNKNOWN,       ///< Not checked since the thresholds were set
+    ADC_ZONE_LOW,           ///< Below the low threshold
+    ADC_ZONE_NORMAL,        ///< Between the thresholds
+    ADC_ZONE_HIGH           ///< Above the high threshold
+    } adc_zone;
+
+/** This structure describes a channel crossing one of its thresholds. The ISR puts
+ *  these in a queue, from which they're read with avr_adc::get_event().
+ */
+typedef struct
+    {
+    unsigned char channel;  ///< The A/D channel, from 0 to 7
+    adc_zone zone;          ///< The zone which the channel has moved into
+    unsigned int value;     ///< The value which moved it there
+    } adc_event;
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds statistics about the time between samples, in counts of the
+ *  time stamp timer. The difference between the longest and shortest is the jitter.
+ */
+
+typedef struct
+    {
+    unsigned int shortest;  ///< The shortest time from one sample to the next
+    unsigned int longest;   ///< The longest time from one sample to the next
+    unsigned long total;    ///< All the times added up, to work out the mean
+    unsigned long count;    ///< How many times have been added up
+    } adc_intervals;
+
 
 //-------------------------------------------------------------------------------------
 /** This class should run the A/D converter on an AVR processor. It should have some
@@ -26,6 +191,187 @@ class avr_adc
         // The ADC class needs a pointer to the serial port used to say hello
         base_text_serial* ptr_to_serial;
 
+        /// This is what the converter is doing now; the ISR checks it for each result
+        volatile adc_mode mode;
+
+        /// This is the channel being read by start(), streaming or block capture
+        unsigned char sample_channel;
+
+        /// This ring buffer holds samples taken by the ISR until the main loop reads them
+        volatile unsigned int sample_buffer[ADC_BUFFER_SIZE];
+
+        /// This is the index in the ring buffer to which the ISR writes the next sample
+        volatile unsigned char buffer_head;
+
+        /// This is the index in the ring buffer from which the next sample is read
+        volatile unsigned char buffer_tail;
+
+        /// This counts samples which were thrown away because the ring buffer was full
+        volatile unsigned int buffer_overruns;
+
+        /// This is the list of channels which are converted, in order, while scanning
+        unsigned char scan_channels[8];
+
+        /// This is how many channels are in the scan list
+        unsigned char scan_count;
+
+        /// This is where in the scan list the conversion now finishing came from
+        volatile unsigned char scan_converting;
+
+        /// This is where in the scan list the conversion now running came from
+        volatile unsigned char scan_pending;
+
+        /// This points to the array into which a frame of scan results is written
+        unsigned int* scan_dest;
+
+        /// This is true if scanning goes on after the first frame is finished
+        bool scan_continuous;
+
+        /// This is true while the ISR is writing results into the current frame
+        volatile bool scan_storing;
+
+        /// This is set by the ISR when a whole frame is ready and cleared by the user
+        volatile bool scan_frame_ready;
+
+        /// This is what has happened to the reading begun with start()
+        volatile adc_status single_state;
+
+        /// This is the result of the reading begun with start()
+        volatile unsigned int single_result;
+
+        /// This counts calls to poll() while waiting, so the wait can be limited
+        unsigned int single_polls;
+
+        /// This counts readings which were given up on because they took too long
+        unsigned int timeout_count;
+
+        /// This function is called by the ISR when a reading is done, if not NULL
+        adc_callback callback;
+
+        /// This pointer is given to the callback function
+        void* p_callback_data;
+
+        /// This is the Timer 1 clock select setting for timed sampling, 0 if not timed
+        unsigned char timer_clock;
+
+        /// This is the Timer 1 count at which each timed conversion is started
+        unsigned int timer_top;
+
+        /// This is the sample rate which the timer really gives, rounded to 1 Hz
+        unsigned int rate_achieved;
+
+        /// This is how far the timer's rate is from the rate asked for, in ppm
+        long rate_error;
+
+        /// These blocks are filled by the ISR in turn while capturing blocks
+        unsigned int sample_blocks[2][ADC_BLOCK_SIZE];
+
+        /// This causes a compiler error (negative array size) if a block of samples
+        /// with the most oversampling bits won't fit in one binary frame
+        typedef char block_check[(5 + (ADC_BLOCK_SIZE * (10 + ADC_MAX_OVERSAMPLE) + 7)
+                                  / 8 <= FRAME_MAX_PAYLOAD) ? 1 : -1];
+
+        /// This is how many samples are in each block which has been handed over
+        unsigned char block_length[2];
+
+        /// This is the number of the block which the ISR is filling
+        volatile unsigned char block_filling;
+
+        /// This is how many samples are in the block being filled
+        volatile unsigned char block_fill_count;
+
+        /// This is the number of the block the user may read, or ADC_NO_BLOCK
+        volatile unsigned char block_ready;
+
+        /// This is how many extra bits oversampling adds to each result, 0 for none
+        unsigned char oversample_bits;
+
+        /// This is how many conversions are added up for each oversampled result
+        unsigned int oversample_ratio;
+
+        /// These add up conversions, one for each place in the scan list
+        unsigned long oversample_sum[8];
+
+        /// These count how many conversions have gone into each sum so far
+        unsigned int oversample_count[8];
+
+        /// These are the filters run on each channel's samples, NULL for none
+        adc_filter* p_filters[8];
+
+        /// This has a one for each channel whose value is checked against thresholds
+        unsigned char window_mask;
+
+        /// These are the thresholds for each channel; above high or below low is out
+        unsigned int window_low[8];
+        unsigned int window_high[8];
+
+        /// These are how far back past a threshold each channel must go to return
+        unsigned int window_hysteresis[8];
+
+        /// These are the zones which the channels were last found in
+        volatile adc_zone window_zone[8];
+
+        /// This queue holds threshold crossing events until the user reads them
+        adc_event events[ADC_EVENT_QUEUE];
+
+        /// These are the indices to which the ISR writes and from which the user reads
+        volatile unsigned char event_head;
+        volatile unsigned char event_tail;
+
+        /// This counts events which were thrown away because the queue was full
+        volatile unsigned int events_lost;
+
+#ifdef ADC_TIMESTAMPS
+        /// This is true if the ISR reads the time stamp timer for each sample
+        bool stamping;
+
+        /// This is false until a sample has been stamped, so there's an interval
+        bool stamp_primed;
+
+        /// This is the time stamp of the most recent sample
+        volatile unsigned int last_stamp;
+
+        /// These are the time stamps of the samples in the ring buffer
+        volatile unsigned int stamp_buffer[ADC_BUFFER_SIZE];
+
+        /// This is the time stamp of the first sample in the frame being stored
+        volatile unsigned int scan_stamp;
+
+        /// These are the statistics about the time between samples
+        volatile adc_intervals intervals;
+
+        // This method stamps a finished sample and adds to the interval statistics
+        void record_stamp (unsigned int);
+#endif
+
+#ifdef PERF_COUNTERS
+        /// These count conversions and the time spent waiting for them
+        volatile adc_counters perf;
+#endif
+
+        // This method empties the oversampling accumulators before a new run starts
+        void clear_oversampling (void);
+
+        // This method stores the result of a reading begun with start()
+        void finish_single (unsigned int);
+
+        // This method gives a finished sample to the channel's filter and thresholds
+        void new_sample (unsigned char, unsigned int);
+
+        // This method gives the block being filled to the user and starts the other
+        void hand_over_block (void);
+
+        // This method reads a channel for a status report, leaving everything alone
+        unsigned int read_quietly (unsigned char);
+
+        // These methods start conversions going, by free running or by the timer,
+        // and stop the timer
+        void start_conversions (void);
+        void stop_timer (void);
+
+        // The status report reads the channels without disturbing the user's setup
+        friend base_text_serial& operator<< (base_text_serial&, avr_adc&);
+
     public:
         // The constructor just says hello at the moment, using the serial port which
         // is specified in the pointer given to it
@@ -34,6 +380,90 @@ class avr_adc
         // This could be a function to read one channel once, returning the result as
         // an unsigned integer. The parameter is the channel number 
         unsigned int read_once (unsigned char);
+
+        // This method reads one channel once and returns the voltage in millivolts
+        unsigned int read_millivolts (unsigned char);
+
+        // These methods take one reading without waiting for it: start() begins the
+        // conversion, poll() or ready() checks on it, and result() picks it up. A
+        // callback can be run by the ISR when the result comes in
+        bool start (unsigned char);
+        adc_status poll (void);
+        bool ready (void);
+        unsigned int result (void);
+        void set_callback (adc_callback, void*);
+        unsigned int timeouts (void);
+
+        // This method tells whether the converter is taking readings of any kind
+        bool busy (void);
+
+        // These methods run the converter in free running mode, with the interrupt
+        // service routine saving results in a ring buffer from which they can be read
+        // in batches whenever the main loop has time
+        void start_streaming (unsigned char);
+        void stop (void);
+        unsigned char samples_available (void);
+        unsigned char read_samples (unsigned int*, unsigned char);
+        unsigned int overruns (void);
+
+        // These methods capture samples from one channel in two blocks: the ISR fills
+        // one while the user reads the other where it is, without copying
+        void start_blocks (unsigned char);
+        const unsigned int* get_block (unsigned char&);
+        void release_block (void);
+
+        // These methods scan a group of channels, one after another, with the ISR
+        // switching the multiplexer; the results are handed over a frame at a time
+        bool start_scan (unsigned char, unsigned int*, bool = true);
+        bool frame_ready (void);
+        void next_frame (void);
+
+        // These methods make streaming, block capture and scanning take samples at a
+        // fixed rate, timed by Timer 1, and tell how close to that rate it can get
+        bool set_sample_rate (unsigned int);
+        unsigned int achieved_rate (void);
+        long rate_error_ppm (void);
+
+        // These methods set and check how many extra bits of resolution streaming and
+        // scanning results get by adding up 4^n conversions for each one
+        bool set_oversampling (unsigned char);
+        unsigned char resolution (void);
+
+        // These methods attach a filter to a channel, which the ISR gives each of
+        // the channel's samples to, and read the filtered value
+        void attach_filter (unsigned char, adc_filter*);
+        unsigned int filtered (unsigned char);
+
+        // These methods set low and high thresholds for a channel, and read the
+        // events which the ISR queues when the channel's value crosses one
+        bool set_window (unsigned char, unsigned int, unsigned int, unsigned int = 0);
+        void clear_window (unsigned char);
+        adc_zone zone (unsigned char);
+        bool get_event (adc_event&);
+        unsigned int lost_events (void);
+
+#ifdef ADC_TIMESTAMPS
+        // These methods stamp each sample with the time from a free running timer,
+        // get the stamps, and keep statistics on the time between samples
+        void use_timestamps (bool);
+        unsigned int stamp (void);
+        unsigned int frame_stamp (void);
+        unsigned char read_samples (unsigned int*, unsigned int*, unsigned char);
+        void get_intervals (adc_intervals&);
+        void clear_intervals (void);
+#endif
+
+        // This method is called by the conversion complete interrupt service routine
+        void conversion_complete (void);
+
+        // This method is called by the Timer 1 interrupt to start timed conversions
+        void timer_trigger (void);
+
+#ifdef PERF_COUNTERS
+        // These methods read and reset the performance counters
+        void get_counters (adc_counters&);
+        void clear_counters (void);
+#endif
     };
 
 
@@ -43,5 +473,18 @@ class avr_adc
 
 base_text_serial& operator<< (base_text_serial&, avr_adc&);
 
+/// This operator prints a threshold crossing event
+base_text_serial& operator<< (base_text_serial&, const adc_event&);
+
+#ifdef ADC_TIMESTAMPS
+/// This operator prints the statistics about the time between samples
+base_text_serial& operator<< (base_text_serial&, const adc_intervals&);
+#endif
+
+#ifdef PERF_COUNTERS
+/// This operator prints the A/D performance counters
+base_text_serial& operator<< (base_text_serial&, const adc_counters&);
+#endif
+
 
 #endif // _AVR_ADC_H_
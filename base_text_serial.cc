@@ -21,13 +21,19 @@
  *      \li 01-12-08  JRR  Added code for the ATmega128 using USART number 1 only
  *      \li 02-13-08  JRR  Split into base class and device specific classes; changed
  *                         from write() to overloaded << operator in the "cout" style
+ *      \li 10-16-26       Numbers converted by num_format functions, not utoa/ltoa
+ *      \li 10-16-26       Everything is sent through write(), a block at a time
+ *      \li 10-16-26       Strings in program memory are printed without using SRAM
  */
 //*************************************************************************************
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include "base_text_serial.h"
+#include "num_format.h"
 
 
 //-------------------------------------------------------------------------------------
@@ -92,6 +98,82 @@ void base_text_serial::transmit_now (void)
     }
 
 
+//-------------------------------------------------------------------------------------
+/** This method writes a block of bytes to the serial device. Unlike puts(), it stops
+ *  at the end of the block rather than at a zero, so it can send binary data. This
+ *  base version just calls putchar() for each byte; descendents should override it
+ *  with something quicker, since all the other writing methods come through here. 
+ *  @param p_data Pointer to the first byte to be written
+ *  @param length The number of bytes to write
+ *  @return True if all the bytes were sent, false if one couldn't be
+ */
+
+bool base_text_serial::write (const void* p_data, size_t length)
+    {
+    const char* p_char = (const char*)p_data;
+
+    while (length--)
+        if (!putchar (*p_char++))
+            return (false);
+
+    return (true);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method writes all the characters in a string until it gets to the '\\0' at 
+ *  the end. The whole string is handed to write() at once. 
+ *  @param str The string to be written
+ */
+
+void base_text_serial::puts (char const* str)
+    {
+    write (str, strlen (str));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method writes a string which is kept in program memory. The characters are 
+ *  read out of program memory FLASH_CHUNK at a time into a small buffer on the stack
+ *  and handed to write() from there, so the string never takes up room in SRAM, and
+ *  buffered devices still get blocks rather than single characters. 
+ *  @param str The string to be written, from FLASH_STR()
+ */
+
+void base_text_serial::puts (const flash_string* str)
+    {
+    const char* p_flash = reinterpret_cast<const char*> (str);
+    char chunk[FLASH_CHUNK];
+    unsigned char count;
+
+    do
+        {
+        for (count = 0; count < FLASH_CHUNK; count++)
+            {
+            chunk[count] = pgm_read_byte (p_flash++);
+            if (chunk[count] == '\0')
+                break;
+            }
+        if (count > 0)
+            write (chunk, count);
+        }
+    while (count == FLASH_CHUNK);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method writes a string which is kept in program memory, as puts() does. 
+ *  @param string The string to be written, from FLASH_STR()
+ */
+
+base_text_serial& base_text_serial::operator<< (const flash_string* string)
+    {
+    puts (string);
+
+    return (*this);
+    }
+
+
 //-------------------------------------------------------------------------------------
 /** This method writes the string whose first character is pointed to by the given
  *  character pointer to the serial device. It acts in about the same way as puts(). 
@@ -101,7 +183,7 @@ void base_text_serial::transmit_now (void)
 
 base_text_serial& base_text_serial::operator<< (const char* string)
     {
-    while (*string) putchar (*string++);
+    write (string, strlen (string));
 
     return (*this);
     }
@@ -115,10 +197,7 @@ base_text_serial& base_text_serial::operator<< (const char* string)
 
 base_text_serial& base_text_serial::operator<< (bool value)
     {
-    if (value)
-        putchar ('T');
-    else
-        putchar ('F');
+    write (value ? "T" : "F", 1);
 
     return (*this);;   
     }
@@ -134,21 +213,9 @@ base_text_serial& base_text_serial::operator<< (bool value)
 
 base_text_serial& base_text_serial::operator<< (unsigned char num)
     {
-    if (base == 2)
-        {
-        for (unsigned char bmask = 0x80; bmask != 0; bmask >>= 1)
-            {
-            if (num & bmask) putchar ('1');
-            else             putchar ('0');
-            }
-        }
-    else
-        {
-        char out_str[9];
+    char out_str[9];
 
-        utoa ((unsigned int)num, out_str, base);
-        puts (out_str);
-        }
+    write (out_str, format_int ((unsigned int)num, base, 8, out_str));
 
     return (*this);
     }
@@ -156,29 +223,18 @@ base_text_serial& base_text_serial::operator<< (unsigned char num)
 
 //-------------------------------------------------------------------------------------
 /** This method writes a character to the serial port as a text string showing the 
- *  8-bit signed number in that character. If one needs to send a character directly
- *  without converting it as a number to a string, then one should use the putchar() 
- *  method instead. 
+ *  8-bit signed number in that character. In decimal, negative numbers get a minus
+ *  sign; in other bases the 8 bits are shown as they are. If one needs to send a
+ *  character directly without converting it as a number to a string, then one should
+ *  use the putchar() method instead. 
  *  @param num The 8-bit number to be sent out
  */
 
 base_text_serial& base_text_serial::operator<< (char num)
     {
-    if (base == 2)
-        {
-        for (unsigned char bmask = 0x80; bmask != 0; bmask >>= 1)
-            {
-            if (num & bmask) putchar ('1');
-            else             putchar ('0');
-            }
-        }
-    else
-        {
-        char out_str[10];
+    char out_str[10];
 
-        utoa ((unsigned int)num, out_str, base);
-        puts (out_str);
-        }
+    write (out_str, format_signed ((signed char)num, base, 8, out_str));
 
     return (*this);
     }
@@ -192,21 +248,9 @@ base_text_serial& base_text_serial::operator<< (char num)
 
 base_text_serial& base_text_serial::operator<< (unsigned int num)
     {
-    if (base == 2)
-        {
-        for (unsigned int bmask = 0x8000; bmask != 0; bmask >>= 1)
-            {
-            if (num & bmask) putchar ('1');
-            else             putchar ('0');
-            }
-        }
-    else
-        {
-        char out_str[17];
+    char out_str[17];
 
-        utoa (num, out_str, base);
-        puts (out_str);
-        }
+    write (out_str, format_int (num, base, 16, out_str));
 
     return (*this);
     }
@@ -214,27 +258,16 @@ base_text_serial& base_text_serial::operator<< (unsigned int num)
 
 //-------------------------------------------------------------------------------------
 /** This method writes an integer to the serial port as a text string showing the 
- *  16-bit signed number in that integer. 
+ *  16-bit signed number in that integer. In decimal, negative numbers get a minus 
+ *  sign; in other bases the 16 bits are shown as they are. 
  *  @param num The 16-bit number to be sent out
  */
 
 base_text_serial& base_text_serial::operator<< (int num)
     {
-    if (base == 2)
-        {
-        for (unsigned int bmask = 0x8000; bmask != 0; bmask >>= 1)
-            {
-            if (num & bmask) putchar ('1');
-            else             putchar ('0');
-            }
-        }
-    else
-        {
-        char out_str[17];
+    char out_str[18];
 
-        utoa (num, out_str, base);
-        puts (out_str);
-        }
+    write (out_str, format_signed (num, base, 16, out_str));
 
     return (*this);
     }
@@ -248,21 +281,9 @@ base_text_serial& base_text_serial::operator<< (int num)
 
 base_text_serial& base_text_serial::operator<< (unsigned long num)
     {
-    if (base == 2)
-        {
-        union {
-            unsigned long whole;
-            unsigned char bits[4];
-            } parts;
-        parts.whole = num;
-        *this << parts.bits[3] << parts.bits[2] << parts.bits[1] << parts.bits[0];
-        }
-    else
-        {
-        char out_str[33];
-        ultoa ((long)num, out_str, base);
-        puts (out_str);
-        }
+    char out_str[NUM_FORMAT_SIZE];
+
+    write (out_str, format_long (num, base, out_str));
 
     return (*this);
     }
@@ -270,27 +291,16 @@ base_text_serial& base_text_serial::operator<< (unsigned long num)
 
 //-------------------------------------------------------------------------------------
 /** This method writes a long integer to the serial port as a text string showing the 
- *  32-bit signed number in that long integer. 
+ *  32-bit signed number in that long integer. In decimal, negative numbers get a 
+ *  minus sign; in other bases the 32 bits are shown as they are. 
  *  @param num The 32-bit number to be sent out
  */
 
 base_text_serial& base_text_serial::operator<< (long num)
     {
-    if (base == 2)
-        {
-        union {
-            unsigned long whole;
-            unsigned char bits[4];
-            } parts;
-        parts.whole = num;
-        *this << parts.bits[3] << parts.bits[2] << parts.bits[1] << parts.bits[0];
-        }
-    else
-        {
-        char out_str[34];
-        ltoa ((long)num, out_str, base);
-        puts (out_str);
-        }
+    char out_str[NUM_FORMAT_SIZE];
+
+    write (out_str, format_signed_long (num, base, out_str));
 
     return (*this);
     }
@@ -306,27 +316,38 @@ base_text_serial& base_text_serial::operator<< (long num)
 
 base_text_serial& base_text_serial::operator<< (ser_manipulator new_base)
     {
-    switch (new_base)
+    base = manipulator_base (new_base, base);
+
+    if (new_base == endl)
+        write ("\r\n", 2);
+    else if (new_base == send_now)
+        transmit_now ();
+
+    return (*this);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function gives the base in which numbers are printed after a manipulator. It's
+ *  shared by base_text_serial and text_stream, so they always agree.
+ *  @param code The manipulator
+ *  @param base The base being used before the manipulator
+ *  @return The base for bin, oct, dec or hex, or the same base for any other code
+ */
+
+unsigned char manipulator_base (ser_manipulator code, unsigned char base)
+    {
+    switch (code)
         {
         case (bin):
-            base = 2;
-            break;
+            return (2);
         case (oct):
-            base = 8;
-            break;
+            return (8);
         case (dec):
-            base = 10;
-            break;
+            return (10);
         case (hex):
-            base = 16;
-            break;
-        case (endl):
-            puts ("\r\n");
-            break;
-        case (send_now):
-            transmit_now ();
-            break;
+            return (16);
+        default:
+            return (base);
         };
-
-    return (*this);
     }
@@ -17,6 +17,8 @@
  *      \li 01-12-08  JRR  Added code for the ATmega128 using USART number 1 only
  *      \li 02-13-08  JRR  Split into base class and device specific classes; changed
  *                         from write() to overloaded << operator in the "cout" style
+ *      \li 10-16-26       Added write() for blocks of characters or binary data
+ *      \li 10-16-26       Added printing of strings kept in program memory
  */
 //*************************************************************************************
 
@@ -24,6 +26,34 @@
 #ifndef _BASE_TEXT_SERIAL_H_
 #define _BASE_TEXT_SERIAL_H_
 
+#include <stddef.h>                         // For size_t
+#include <avr/pgmspace.h>                   // For strings kept in program memory
+
+
+//-------------------------------------------------------------------------------------
+/** This type stands for a string constant which is kept in program memory (flash)
+ *  rather than in SRAM. It's never defined; a pointer to one is really a pointer to
+ *  characters in program memory, and its type makes the compiler pick the << operator
+ *  and puts() method which read them from there. Such pointers are made with the
+ *  FLASH_STR() macro.
+ */
+
+class flash_string;
+
+/** This macro puts a string constant in program memory and gives a pointer to it as a
+ *  flash_string, so it can be printed without ever being copied into SRAM:
+ *  \code
+ *    serial << FLASH_STR ("Reading: ") << value << endl;
+ *  \endcode
+ *  Like PSTR(), which it uses, it can only be used inside a function.
+ */
+#define FLASH_STR(str)      (reinterpret_cast<const flash_string*> (PSTR (str)))
+
+/** This is how many characters of a string in program memory are copied into a 
+ *  buffer on the stack at a time, so they can be given to write() in blocks
+ */
+#define FLASH_CHUNK         16
+
 
 //-------------------------------------------------------------------------------------
 /** This enumeration is used to change the display base for the output stream from the
@@ -53,6 +83,7 @@ typedef enum {
  *    \li ready_to_send () - Checks if the port is ready to transmit a character
  *    \li putchar() - Sends a single character over the communications line
  *    \li puts() - Sends a character string
+ *    \li write() - Sends a block of characters or bytes, which may include zeros
  *    \li operator<<() - Methods which convert numbers to strings and send them
  */
 
@@ -73,8 +104,10 @@ class base_text_serial
     public:
         base_text_serial (void);            // Simple constructor doesn't do much
         virtual bool ready_to_send (void);  // Virtual and not defined in base class
-        virtual bool putchar (char) { }     ///< Virtual and not defined in base class
-        virtual void puts (char const*) { } ///< Virtual and not defined in base class
+        virtual bool putchar (char) { return (false); } ///< Not defined in base class
+        virtual void puts (char const*);    // Write a string, using write()
+        void puts (const flash_string*);    // Write a string from program memory
+        virtual bool write (const void*, size_t); // Write a block of bytes
         virtual bool check_for_char (void); // Check if a character is in the buffer
         virtual char getchar (void);        // Get a character; wait if none is ready
         virtual void transmit_now (void);   // Immediately transmit any buffered data
@@ -83,6 +116,7 @@ class base_text_serial
         // strings out the serial device; manipulators change the formatting
         base_text_serial& operator<< (bool);
         base_text_serial& operator<< (const char*);
+        base_text_serial& operator<< (const flash_string*);
         base_text_serial& operator<< (unsigned char);
         base_text_serial& operator<< (char num);
         base_text_serial& operator<< (unsigned int);
@@ -93,4 +127,8 @@ class base_text_serial
         base_text_serial& operator<< (ser_manipulator);
     };
 
+
+// This function gives the base in which numbers are printed after a manipulator
+unsigned char manipulator_base (ser_manipulator, unsigned char);
+
 #endif  // _BASE_TEXT_SERIAL_H_
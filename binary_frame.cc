@@ -0,0 +1,207 @@
+//*************************************************************************************
+/** \file binary_frame.cc
+ *        This file contains a class which sends A/D data over a serial device in
+ *        compact binary frames. See binary_frame.h for a description of the frame
+ *        format.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#include <stdlib.h>
+#include <util/crc16.h>
+#include "binary_frame.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor sets up a frame writer. It saves a pointer to the serial device
+ *  which will be used to send the frames and starts the sequence numbers at zero.
+ *  @param p_serial_port A pointer to the serial device through which to send frames
+ */
+
+binary_frame_writer::binary_frame_writer (base_text_serial* p_serial_port)
+    {
+    p_serial = p_serial_port;
+    frame_length = 0;
+    sequence = 0;
+    bit_buffer = 0;
+    bit_count = 0;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method begins a new frame, throwing away anything left from an unfinished
+ *  one. The frame begins with the type byte and the sequence number.
+ *  @param type The type byte which tells the receiver what kind of frame this is
+ */
+
+void binary_frame_writer::start_frame (unsigned char type)
+    {
+    frame_length = 0;
+    bit_buffer = 0;
+    bit_count = 0;
+
+    add_byte (type);
+    add_byte (sequence);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method adds one byte to the frame being built.
+ *  @param data The byte to be added
+ *  @return True if the byte was added, false if the frame was already full
+ */
+
+bool binary_frame_writer::add_byte (unsigned char data)
+    {
+    if (frame_length >= FRAME_MAX_PAYLOAD)
+        return (false);
+
+    frame[frame_length++] = data;
+    return (true);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method packs up to eight bits into the frame, least significant bit first.
+ *  Whole bytes are added to the frame as soon as they're filled.
+ *  @param bits The bits to be added, right justified
+ *  @param count The number of bits to be added, from 1 to 8
+ */
+
+void binary_frame_writer::add_bits (unsigned char bits, unsigned char count)
+    {
+    bit_buffer |= (unsigned int)bits << bit_count;
+    bit_count += count;
+
+    if (bit_count >= 8)
+        {
+        add_byte ((unsigned char)bit_buffer);
+        bit_buffer >>= 8;
+        bit_count -= 8;
+        }
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method adds any bits left in the bit buffer to the frame as a last byte,
+ *  padded at the top with zeros.
+ */
+
+void binary_frame_writer::flush_bits (void)
+    {
+    if (bit_count > 0)
+        add_byte ((unsigned char)bit_buffer);
+
+    bit_buffer = 0;
+    bit_count = 0;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method finishes the frame being built and sends it. The CRC-CCITT checksum of
+ *  the frame is added, high byte first. Then the frame is sent with COBS encoding:
+ *  each run of nonzero bytes is sent after a code byte which is one more than the
+ *  length of the run, and the zero which ends each run is left out. Frames are never
+ *  long enough to need the special code for runs of 254 nonzero bytes. A zero byte
+ *  is sent at the end to mark the end of the frame.
+ */
+
+void binary_frame_writer::finish_frame (void)
+    {
+    unsigned int crc = 0xFFFF;
+
+    flush_bits ();
+
+    for (unsigned char index = 0; index < frame_length; index++)
+        crc = _crc_ccitt_update (crc, frame[index]);
+
+    frame[frame_length++] = (unsigned char)(crc >> 8);
+    frame[frame_length++] = (unsigned char)crc;
+
+    for (unsigned char start = 0; start <= frame_length; )
+        {
+        unsigned char end = start;
+
+        while (end < frame_length && frame[end] != 0)
+            end++;
+
+        p_serial->putchar ((char)(end - start + 1));
+        p_serial->write (frame + start, end - start);
+
+        start = end + 1;
+        }
+    p_serial->putchar ('\0');
+
+    frame_length = 0;
+    sequence++;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends one frame of A/D samples. The frame holds the channel mask and
+ *  then the samples, each 10 bits long, packed one after another least significant
+ *  bit first, so that four samples take up five bytes.
+ *  @param channel_mask A bitmask with a one for each channel whose sample is sent
+ *  @param samples An array of samples, one for each channel in the mask, in order
+ *      of channel number, lowest first; this is how avr_adc::start_scan() fills it
+ */
+
+void binary_frame_writer::send_samples (unsigned char channel_mask,
+                                        const unsigned int* samples)
+    {
+    start_frame (FRAME_SYNC);
+    add_byte (channel_mask);
+
+    for (unsigned char bit = 0x01; bit != 0; bit <<= 1)
+        {
+        if (channel_mask & bit)
+            {
+            unsigned int sample = *samples++;
+
+            add_bits ((unsigned char)sample, 8);
+            add_bits ((unsigned char)(sample >> 8) & 0x03, 2);
+            }
+        }
+
+    finish_frame ();
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends one frame holding a block of samples from one channel, such as a
+ *  block from avr_adc::get_block(). The samples are packed straight from the array
+ *  they're in, so the block needn't be copied anywhere first. The frame holds the 
+ *  channel number, the number of bits in each sample, the number of samples, and then
+ *  the samples packed one after another least significant bit first. 
+ *  @param channel The A/D channel from which the samples came
+ *  @param bits The number of bits in each sample, from 8 to 16; this is 10 unless the
+ *      samples were oversampled
+ *  @param samples A pointer to the first sample in the block
+ *  @param count The number of samples in the block
+ *  @return True if the frame was sent, false if the samples won't fit in one frame
+ */
+
+bool binary_frame_writer::send_block (unsigned char channel, unsigned char bits,
+                                      const unsigned int* samples, unsigned char count)
+    {
+    if (bits < 8 || bits > 16
+        || 5 + ((unsigned int)count * bits + 7) / 8 > FRAME_MAX_PAYLOAD)
+        return (false);
+
+    start_frame (FRAME_BLOCK);
+    add_byte (channel);
+    add_byte (bits);
+    add_byte (count);
+
+    for (const unsigned int* p_end = samples + count; samples < p_end; samples++)
+        {
+        add_bits ((unsigned char)*samples, 8);
+        if (bits > 8)
+            add_bits ((unsigned char)(*samples >> 8) & ((1 << (bits - 8)) - 1), bits - 8);
+        }
+
+    finish_frame ();
+    return (true);
+    }
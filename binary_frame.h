@@ -0,0 +1,86 @@
+//*************************************************************************************
+/** \file binary_frame.h
+ *        This file contains a class which sends A/D data over a serial device in
+ *        compact binary frames instead of text. A four channel report takes about a
+ *        dozen bytes this way, rather than the couple of hundred it takes as text.
+ *
+ *        Each frame holds a type (sync) byte, a sequence number, a channel mask, the
+ *        10-bit samples packed four to every five bytes, and a CRC-CCITT checksum. A
+ *        block frame holds instead the channel number, the number of bits in each
+ *        sample, the number of samples, and the samples from one channel packed the
+ *        same way. The whole thing is COBS (Consistent Overhead Byte Stuffing) encoded
+ *        so that it contains no zero bytes, and a zero is sent after it to mark the
+ *        end. A receiver can therefore always find the start of the next frame by
+ *        waiting for a zero, even if it starts listening in the middle of the stream.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _BINARY_FRAME_H_
+#define _BINARY_FRAME_H_
+
+#include "base_text_serial.h"               // Pull in the base class header file
+
+
+/// This is the type byte which begins a frame of packed A/D samples
+#define FRAME_SYNC          0xA5
+
+/// This is the type byte which begins a frame holding a block of samples from one channel
+#define FRAME_BLOCK         0xA6
+
+/// This is the largest number of bytes a frame can hold, not counting the checksum
+#define FRAME_MAX_PAYLOAD   64
+
+
+//-------------------------------------------------------------------------------------
+/** This class builds binary frames and sends them through a serial device. A frame
+ *  is built by calling start_frame(), then add_byte() for each byte of data, then
+ *  finish_frame(), which adds the checksum, encodes the frame, and sends it. The
+ *  send_samples() method does all of that for a set of A/D readings.
+ */
+
+class binary_frame_writer
+    {
+    protected:
+        /// This is a pointer to the serial device through which frames are sent
+        base_text_serial* p_serial;
+
+        /// This buffer holds the frame being built, with room for the checksum
+        unsigned char frame[FRAME_MAX_PAYLOAD + 2];
+
+        /// This is the number of bytes in the frame being built
+        unsigned char frame_length;
+
+        /// This is the sequence number which will be put in the next frame
+        unsigned char sequence;
+
+        /// These hold bits which have been packed but not yet made into a whole byte
+        unsigned int bit_buffer;
+
+        /// This is the number of bits being held in bit_buffer
+        unsigned char bit_count;
+
+        void add_bits (unsigned char, unsigned char);
+        void flush_bits (void);
+
+    public:
+        // The constructor saves a pointer to the serial device to be used
+        binary_frame_writer (base_text_serial*);
+
+        // These methods build a frame and send it out
+        void start_frame (unsigned char);
+        bool add_byte (unsigned char);
+        void finish_frame (void);
+
+        // This method sends a frame of 10-bit A/D samples from the given channels
+        void send_samples (unsigned char, const unsigned int*);
+
+        // This method sends a block of samples from one channel, read where they are
+        bool send_block (unsigned char, unsigned char, const unsigned int*, 
+                         unsigned char);
+    };
+
+#endif  // _BINARY_FRAME_H_
@@ -0,0 +1,127 @@
+//*************************************************************************************
+/** \file delta_frame.cc
+ *        This file contains a class which sends A/D scans as differences from the
+ *        scan before, zigzag and varint encoded, many scans to a frame. See
+ *        delta_frame.h for a description of the frame format.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#include <stdlib.h>
+#include "delta_frame.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor sets up a compressed frame writer. The first frame will be a key
+ *  frame.
+ *  @param p_serial_port A pointer to the serial device through which to send frames
+ *  @param mask A bitmask with a one for each channel in a scan, as given to
+ *      avr_adc::start_scan()
+ */
+
+delta_frame_writer::delta_frame_writer (base_text_serial* p_serial_port,
+                                        unsigned char mask)
+    : binary_frame_writer (p_serial_port)
+    {
+    channel_mask = mask;
+    channel_count = 0;
+    for (unsigned char bit = 0x01; bit != 0; bit <<= 1)
+        if (mask & bit)
+            channel_count++;
+
+    scans_in_frame = 0;
+    frames_to_key = 0;
+    for (unsigned char index = 0; index < 8; index++)
+        last_sample[index] = 0;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method adds a number to the frame as a varint, seven bits to a byte with the
+ *  lowest bits first. Every byte but the last has its top bit set.
+ *  @param number The number to be added
+ */
+
+void delta_frame_writer::add_varint (unsigned long number)
+    {
+    while (number > 0x7F)
+        {
+        add_byte ((unsigned char)number | 0x80);
+        number >>= 7;
+        }
+    add_byte ((unsigned char)number);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method adds one scan to the frame being built. If there's no frame being
+ *  built, one is started; the first scan in a key frame is sent as differences from
+ *  zero. When there isn't room left for another scan, even if every difference took
+ *  the most bytes it can, the frame is sent.
+ *  @param samples An array of samples, one for each channel in the mask, in order
+ *      of channel number, lowest first; this is how avr_adc::start_scan() fills it
+ */
+
+void delta_frame_writer::add_scan (const unsigned int* samples)
+    {
+    if (scans_in_frame == 0)
+        {
+        bool key = (frames_to_key == 0);
+
+        start_frame (FRAME_DELTA);
+        add_byte (channel_mask);
+        add_byte (key ? DELTA_KEY_FLAG : 0);
+
+        if (key)
+            {
+            for (unsigned char index = 0; index < channel_count; index++)
+                last_sample[index] = 0;
+            frames_to_key = DELTA_KEY_INTERVAL;
+            }
+        frames_to_key--;
+        }
+
+    for (unsigned char index = 0; index < channel_count; index++)
+        {
+        long delta = (long)samples[index] - (long)last_sample[index];
+
+        // Zigzag: the sign goes to the bottom bit, so small numbers stay small
+        add_varint (((unsigned long)delta << 1) ^ (unsigned long)(delta >> 31));
+        last_sample[index] = samples[index];
+        }
+    scans_in_frame++;
+
+    unsigned int worst_scan = (unsigned int)channel_count * DELTA_MAX_BYTES;
+    if (frame_length + worst_scan > FRAME_MAX_PAYLOAD)
+        flush ();
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends the frame being built, if it has any scans in it. It should be
+ *  called when the receiver mustn't be kept waiting for a full frame, such as when
+ *  scanning stops.
+ */
+
+void delta_frame_writer::flush (void)
+    {
+    if (scans_in_frame == 0)
+        return;
+
+    finish_frame ();
+    scans_in_frame = 0;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method makes the next frame which is started a key frame, for example when a
+ *  receiver has asked to start over. The frame being built is sent first.
+ */
+
+void delta_frame_writer::send_key (void)
+    {
+    flush ();
+    frames_to_key = 0;
+    }
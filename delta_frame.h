@@ -0,0 +1,87 @@
+//*************************************************************************************
+/** \file delta_frame.h
+ *        This file contains a class which sends A/D scans in compressed binary
+ *        frames. Samples from a sensor change only a little from one scan to the
+ *        next, so instead of each sample, the difference from the channel's last
+ *        sample is sent. Each difference is zigzag encoded, which folds the signed
+ *        number into an unsigned one with small numbers staying small (0, -1, 1, -2,
+ *        2 become 0, 1, 2, 3, 4), and then written as a varint: seven bits to a
+ *        byte, low bits first, with the top bit set in every byte but the last. A
+ *        difference from -64 to 63 takes one byte, and one from -8192 to 8191 two.
+ *
+ *        Many scans are put in each frame, which is sent with the same CRC and COBS
+ *        framing as the frames in binary_frame.h. A frame holds the type byte
+ *        FRAME_DELTA, the sequence number, the channel mask, a flags byte, and then
+ *        the differences, scan by scan, in order of channel number. In a key frame
+ *        (flag bit 0 set) the first scan is sent as differences from zero, so a
+ *        receiver which has just started listening, or which has lost a frame, can
+ *        pick up the stream there; every DELTA_KEY_INTERVAL'th frame is a key frame.
+ *        A receiver must skip frames until a key frame comes, and after any gap in
+ *        the sequence numbers. The program host/delta_decode does this on a PC.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _DELTA_FRAME_H_
+#define _DELTA_FRAME_H_
+
+#include "binary_frame.h"                   // Frame building, checksum, and COBS
+
+
+/// This is the type byte which begins a frame of compressed scans
+#define FRAME_DELTA         0xA7
+
+/// This flag in the flags byte marks a key frame
+#define DELTA_KEY_FLAG      0x01
+
+/// This is how many frames are sent for each key frame
+#define DELTA_KEY_INTERVAL  8
+
+/// This is the most bytes one difference can take: 16-bit samples need 3
+#define DELTA_MAX_BYTES     3
+
+
+//-------------------------------------------------------------------------------------
+/** This class packs A/D scans into compressed frames and sends them through a serial
+ *  device. Each call to add_scan() adds one scan; a frame is sent whenever there
+ *  isn't room in it for another scan, or when flush() is called.
+ */
+
+class delta_frame_writer : public binary_frame_writer
+    {
+    protected:
+        /// This is the mask of the channels in each scan, as given to avr_adc
+        unsigned char channel_mask;
+
+        /// This is the number of channels in the mask
+        unsigned char channel_count;
+
+        /// These are the last samples sent from each channel in the scan
+        unsigned int last_sample[8];
+
+        /// This is the number of scans in the frame being built; 0 if none started
+        unsigned char scans_in_frame;
+
+        /// This counts frames down to the next key frame; a key frame is sent at 0
+        unsigned char frames_to_key;
+
+        void add_varint (unsigned long);
+
+    public:
+        // The constructor saves the serial device and which channels are in a scan
+        delta_frame_writer (base_text_serial*, unsigned char);
+
+        // This method adds a scan of samples, sending a frame if it's full
+        void add_scan (const unsigned int*);
+
+        // This method sends the scans which haven't been sent yet
+        void flush (void);
+
+        // This method makes the next frame a key frame
+        void send_key (void);
+    };
+
+#endif  // _DELTA_FRAME_H_
@@ -0,0 +1,28 @@
+//*************************************************************************************
+/** \file host/avr/interrupt.h
+ *        This file stands in for avr-libc's <avr/interrupt.h> when the drivers are
+ *        built to run on a PC. Interrupt service routines become ordinary functions
+ *        which the simulation calls, and sei() and cli() change the I bit in the
+ *        simulated SREG.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#ifndef _SIM_AVR_INTERRUPT_H_
+#define _SIM_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+
+/// This macro turns interrupts on by setting the I bit in the status register
+#define sei()               (SREG |= 0x80)
+
+/// This macro turns interrupts off by clearing the I bit in the status register
+#define cli()               (SREG &= ~0x80)
+
+/// This macro declares an interrupt service routine as a function the simulation calls
+#define ISR(vector)         extern "C" void vector (void); extern "C" void vector (void)
+
+#endif // _SIM_AVR_INTERRUPT_H_
@@ -0,0 +1,253 @@
+//*************************************************************************************
+/** \file host/avr/io.h
+ *        This file stands in for avr-libc's <avr/io.h> when the drivers are built to
+ *        run on a PC. It gives the ATmega128's register and bit names, with each
+ *        register at its data memory address within the simulated I/O page. See
+ *        avr_sim.h for how the simulation works.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#ifndef _SIM_AVR_IO_H_
+#define _SIM_AVR_IO_H_
+
+#include <stdint.h>
+#include "../avr_sim.h"
+
+#ifndef __AVR_ATmega128__
+    #error The host simulation only models the ATmega128
+#endif
+
+
+/// These macros turn a data memory address into a simulated register
+#define _SFR_MEM8(addr)     (*(volatile uint8_t*)(sim_io + (addr)))
+#define _SFR_MEM16(addr)    (*(volatile uint16_t*)(sim_io + (addr)))
+
+#define _BV(bit)            (1 << (bit))
+
+
+//-------------------------------------------------------------------------------------
+// The status register and stack pointer
+
+#define SREG        _SFR_MEM8 (0x5F)
+#define SP          _SFR_MEM16 (0x5D)
+#define SPL         _SFR_MEM8 (0x5D)
+#define SPH         _SFR_MEM8 (0x5E)
+
+//-------------------------------------------------------------------------------------
+// The MCU control register, which holds the sleep mode bits
+
+#define MCUCR       _SFR_MEM8 (0x55)
+
+#define SRE         7
+#define SRW10       6
+#define SE          5
+#define SM1         4
+#define SM0         3
+#define SM2         2
+#define IVSEL       1
+#define IVCE        0
+
+//-------------------------------------------------------------------------------------
+// Timers 0 and 1 and the timer interrupt mask and flag registers
+
+#define TCCR0       _SFR_MEM8 (0x53)
+#define TCNT0       _SFR_MEM8 (0x52)
+#define OCR0        _SFR_MEM8 (0x51)
+#define ASSR        _SFR_MEM8 (0x50)
+#define TIMSK       _SFR_MEM8 (0x57)
+#define TIFR        _SFR_MEM8 (0x56)
+
+#define TCCR1A      _SFR_MEM8 (0x4F)
+#define TCCR1B      _SFR_MEM8 (0x4E)
+#define TCNT1       _SFR_MEM16 (0x4C)
+#define TCNT1L      _SFR_MEM8 (0x4C)
+#define TCNT1H      _SFR_MEM8 (0x4D)
+#define OCR1A       _SFR_MEM16 (0x4A)
+#define OCR1AL      _SFR_MEM8 (0x4A)
+#define OCR1AH      _SFR_MEM8 (0x4B)
+#define OCR1B       _SFR_MEM16 (0x48)
+#define OCR1BL      _SFR_MEM8 (0x48)
+#define OCR1BH      _SFR_MEM8 (0x49)
+#define ICR1        _SFR_MEM16 (0x46)
+
+#define FOC0        7
+#define WGM00       6
+#define COM01       5
+#define COM00       4
+#define WGM01       3
+#define CS02        2
+#define CS01        1
+#define CS00        0
+
+#define COM1A1      7
+#define COM1A0      6
+#define COM1B1      5
+#define COM1B0      4
+#define COM1C1      3
+#define COM1C0      2
+#define WGM11       1
+#define WGM10       0
+
+#define ICNC1       7
+#define ICES1       6
+#define WGM13       4
+#define WGM12       3
+#define CS12        2
+#define CS11        1
+#define CS10        0
+
+#define OCIE2       7
+#define TOIE2       6
+#define TICIE1      5
+#define OCIE1A      4
+#define OCIE1B      3
+#define TOIE1       2
+#define OCIE0       1
+#define TOIE0       0
+
+#define OCF2        7
+#define TOV2        6
+#define ICF1        5
+#define OCF1A       4
+#define OCF1B       3
+#define TOV1        2
+#define OCF0        1
+#define TOV0        0
+
+//-------------------------------------------------------------------------------------
+// Timer 3 and the extended timer interrupt mask and flag registers
+
+#define TCCR3A      _SFR_MEM8 (0x8B)
+#define TCCR3B      _SFR_MEM8 (0x8A)
+#define TCCR3C      _SFR_MEM8 (0x8C)
+#define TCNT3       _SFR_MEM16 (0x88)
+#define TCNT3L      _SFR_MEM8 (0x88)
+#define TCNT3H      _SFR_MEM8 (0x89)
+#define OCR3A       _SFR_MEM16 (0x86)
+#define OCR3AL      _SFR_MEM8 (0x86)
+#define OCR3AH      _SFR_MEM8 (0x87)
+#define ETIMSK      _SFR_MEM8 (0x7D)
+#define ETIFR       _SFR_MEM8 (0x7C)
+
+#define WGM33       4
+#define WGM32       3
+#define CS32        2
+#define CS31        1
+#define CS30        0
+
+#define TICIE3      5
+#define OCIE3A      4
+#define OCIE3B      3
+#define TOIE3       2
+#define OCIE3C      1
+#define OCIE1C      0
+
+#define ICF3        5
+#define OCF3A       4
+#define OCF3B       3
+#define TOV3        2
+#define OCF3C       1
+#define OCF1C       0
+
+//-------------------------------------------------------------------------------------
+// The A/D converter
+
+#define ADMUX       _SFR_MEM8 (0x27)
+#define ADCSRA      _SFR_MEM8 (0x26)
+#define ADCH        _SFR_MEM8 (0x25)
+#define ADCL        _SFR_MEM8 (0x24)
+#define ADCW        _SFR_MEM16 (0x24)
+#define ADC         _SFR_MEM16 (0x24)
+
+#define REFS1       7
+#define REFS0       6
+#define ADLAR       5
+#define MUX4        4
+#define MUX3        3
+#define MUX2        2
+#define MUX1        1
+#define MUX0        0
+
+#define ADEN        7
+#define ADSC        6
+#define ADFR        5
+#define ADIF        4
+#define ADIE        3
+#define ADPS2       2
+#define ADPS1       1
+#define ADPS0       0
+
+//-------------------------------------------------------------------------------------
+// The two USART's
+
+#define UDR0        _SFR_MEM8 (0x2C)
+#define UCSR0A      _SFR_MEM8 (0x2B)
+#define UCSR0B      _SFR_MEM8 (0x2A)
+#define UBRR0L      _SFR_MEM8 (0x29)
+#define UBRR0H      _SFR_MEM8 (0x90)
+#define UCSR0C      _SFR_MEM8 (0x95)
+
+#define UDR1        _SFR_MEM8 (0x9C)
+#define UCSR1A      _SFR_MEM8 (0x9B)
+#define UCSR1B      _SFR_MEM8 (0x9A)
+#define UBRR1L      _SFR_MEM8 (0x99)
+#define UBRR1H      _SFR_MEM8 (0x98)
+#define UCSR1C      _SFR_MEM8 (0x9D)
+
+#define RXC0        7
+#define TXC0        6
+#define UDRE0       5
+#define FE0         4
+#define DOR0        3
+#define UPE0        2
+#define U2X0        1
+#define MPCM0       0
+
+#define RXCIE0      7
+#define TXCIE0      6
+#define UDRIE0      5
+#define RXEN0       4
+#define TXEN0       3
+#define UCSZ02      2
+#define RXB80       1
+#define TXB80       0
+
+#define RXC1        7
+#define TXC1        6
+#define UDRE1       5
+#define FE1         4
+#define DOR1        3
+#define UPE1        2
+#define U2X1        1
+#define MPCM1       0
+
+#define RXCIE1      7
+#define TXCIE1      6
+#define UDRIE1      5
+#define RXEN1       4
+#define TXEN1       3
+#define UCSZ12      2
+#define RXB81       1
+#define TXB81       0
+
+//-------------------------------------------------------------------------------------
+// Interrupt vectors are functions which the simulation calls
+
+#define TIMER1_COMPA_vect   sim_vect_timer1_compa
+#define TIMER1_OVF_vect     sim_vect_timer1_ovf
+#define TIMER0_COMP_vect    sim_vect_timer0_comp
+#define TIMER0_OVF_vect     sim_vect_timer0_ovf
+#define USART0_RX_vect      sim_vect_usart0_rx
+#define USART0_UDRE_vect    sim_vect_usart0_udre
+#define USART0_TX_vect      sim_vect_usart0_tx
+#define ADC_vect            sim_vect_adc
+#define TIMER3_COMPA_vect   sim_vect_timer3_compa
+#define TIMER3_OVF_vect     sim_vect_timer3_ovf
+#define USART1_RX_vect      sim_vect_usart1_rx
+#define USART1_UDRE_vect    sim_vect_usart1_udre
+#define USART1_TX_vect      sim_vect_usart1_tx
+
+#endif // _SIM_AVR_IO_H_
@@ -0,0 +1,28 @@
+//*************************************************************************************
+/** \file host/avr/pgmspace.h
+ *        This file stands in for avr-libc's <avr/pgmspace.h> when the drivers are
+ *        built to run on a PC. A PC has only one kind of memory, so strings which
+ *        would be put in program memory stay where they are, and reading a byte from
+ *        program memory is just reading it.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#ifndef _SIM_AVR_PGMSPACE_H_
+#define _SIM_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+
+
+/// This attribute would put a variable in program memory; here it does nothing
+#define PROGMEM
+
+/// This macro would put a string constant in program memory and give its address
+#define PSTR(str)           (str)
+
+/// This macro reads one byte from program memory
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+
+#endif // _SIM_AVR_PGMSPACE_H_
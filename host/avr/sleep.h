@@ -0,0 +1,41 @@
+//*************************************************************************************
+/** \file host/avr/sleep.h
+ *        This file stands in for avr-libc's <avr/sleep.h> when the drivers are built
+ *        to run on a PC. The sleep mode and enable bits are kept in the simulated
+ *        MCUCR, and sleep_cpu() lets simulated time pass until an interrupt runs.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#ifndef _SIM_AVR_SLEEP_H_
+#define _SIM_AVR_SLEEP_H_
+
+#include <avr/io.h>
+
+
+/// These are the ATmega128's sleep modes, as they're put into the SM bits of MCUCR
+#define SLEEP_MODE_IDLE         0
+#define SLEEP_MODE_ADC          _BV (SM0)
+#define SLEEP_MODE_PWR_DOWN     _BV (SM1)
+#define SLEEP_MODE_PWR_SAVE     (_BV (SM0) | _BV (SM1))
+#define SLEEP_MODE_STANDBY      (_BV (SM1) | _BV (SM2))
+#define SLEEP_MODE_EXT_STANDBY  (_BV (SM0) | _BV (SM1) | _BV (SM2))
+
+/// This macro picks the sleep mode which sleep_cpu() will use
+#define set_sleep_mode(mode)    (MCUCR = (MCUCR & ~(_BV (SM0) | _BV (SM1) | _BV (SM2))) \
+                                         | (mode))
+
+/// These macros set and clear the sleep enable bit
+#define sleep_enable()          (MCUCR |= _BV (SE))
+#define sleep_disable()         (MCUCR &= ~_BV (SE))
+
+/// This macro stands for the SLEEP instruction
+#define sleep_cpu()             sim_sleep ()
+
+/// This macro sleeps once, turning the enable bit on just for that time
+#define sleep_mode()            do { sleep_enable (); sleep_cpu (); sleep_disable (); } \
+                                while (0)
+
+#endif // _SIM_AVR_SLEEP_H_
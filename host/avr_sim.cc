@@ -0,0 +1,1178 @@
+//*************************************************************************************
+/** \file avr_sim.cc
+ *        This file contains a simulation of the ATmega128's A/D converter, USART's
+ *        and timers which lets the drivers in this project run on an x86-64 Linux PC.
+ *        See avr_sim.h for a description of how it works.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ *      \li 10-16-26       Signal handlers moved to a stack of their own
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <avr/io.h>
+#include "avr_sim.h"
+
+#if !defined (__x86_64__) || !defined (__linux__)
+    #error The AVR simulation needs an x86-64 Linux host
+#endif
+
+#ifndef F_CPU
+    #define F_CPU           8000000UL       ///< Simulated clock if none is given
+#endif
+
+/// This is the trap flag in the x86 flags register, used to single step
+#define TRAP_FLAG           0x0100
+
+/// This bit of the page fault error code is set if the fault was caused by a write
+#define FAULT_WRITE         0x0002
+
+/// This is how often, in microseconds, the host timer checks for a spinning program
+#define IDLE_CHECK_US       200
+
+/** This is the size of the stack on which the signal handlers, and so the interrupt
+ *  routines, run; they're kept off the program's stack so that mem_monitor can see
+ *  how much of it the program itself uses
+ */
+#define SIGNAL_STACK_SIZE   262144
+
+
+//-------------------------------------------------------------------------------------
+// The simulated I/O space and the state of the simulated peripherals
+
+volatile uint8_t sim_io[SIM_IO_SIZE] __attribute__ ((aligned (SIM_IO_SIZE)));
+
+/** This type of function is an interrupt service routine. The routines are declared
+ *  weak so that programs which don't define them still link.
+ */
+typedef void (*sim_vector) (void);
+
+extern "C"
+    {
+    void sim_vect_timer1_compa (void) __attribute__ ((weak));
+    void sim_vect_timer1_ovf (void) __attribute__ ((weak));
+    void sim_vect_timer0_comp (void) __attribute__ ((weak));
+    void sim_vect_timer0_ovf (void) __attribute__ ((weak));
+    void sim_vect_usart0_rx (void) __attribute__ ((weak));
+    void sim_vect_usart0_udre (void) __attribute__ ((weak));
+    void sim_vect_usart0_tx (void) __attribute__ ((weak));
+    void sim_vect_adc (void) __attribute__ ((weak));
+    void sim_vect_timer3_compa (void) __attribute__ ((weak));
+    void sim_vect_timer3_ovf (void) __attribute__ ((weak));
+    void sim_vect_usart1_rx (void) __attribute__ ((weak));
+    void sim_vect_usart1_udre (void) __attribute__ ((weak));
+    void sim_vect_usart1_tx (void) __attribute__ ((weak));
+    }
+
+/// This structure holds the state of the A/D converter which isn't in its registers
+static struct
+    {
+    bool busy;                              ///< True while a conversion is running
+    bool first;                             ///< True if the next one is the first
+    unsigned char channel;                  ///< Channel latched when conversion began
+    unsigned long long done_at;             ///< Cycle at which the conversion ends
+    unsigned long conversions;              ///< Number of conversions finished
+    bool stalled;                           ///< True if conversions never finish
+    sim_adc_source source;                  ///< Function giving the input voltages
+    } adc;
+
+/// This structure holds the state of a USART which isn't in its registers
+struct sim_uart
+    {
+    unsigned int udr;                       ///< Address of the data register
+    unsigned int ucsra;                     ///< Address of control and status reg. A
+    unsigned int ucsrb;                     ///< Address of control and status reg. B
+    unsigned int ubrrl;                     ///< Address of the low baud rate byte
+    unsigned int ubrrh;                     ///< Address of the high baud rate byte
+    sim_vector rx_vect;                     ///< Receive complete interrupt routine
+    sim_vector udre_vect;                   ///< Data register empty interrupt routine
+    sim_vector tx_vect;                     ///< Transmit complete interrupt routine
+
+    bool tx_busy;                           ///< True while a character is shifted out
+    bool holding_full;                      ///< True if a character waits in UDR
+    uint8_t shifter;                        ///< Character being shifted out
+    uint8_t holding;                        ///< Character waiting to be shifted out
+    unsigned long long tx_done_at;          ///< Cycle at which the shifting ends
+    unsigned long long last_tx_at;          ///< Cycle at which the last one finished
+
+    uint8_t rx_data;                        ///< Character which can be read from UDR
+    char* p_rx_queue;                       ///< Characters waiting to be received
+    unsigned int rx_queued;                 ///< Number of characters in the queue
+    unsigned int rx_next;                   ///< Index of the next one to arrive
+    unsigned long long rx_next_at;          ///< Cycle at which the next one arrives
+
+    char capture[SIM_CAPTURE_SIZE];         ///< Characters which have been sent
+    unsigned int captured;                  ///< Number of characters captured
+    };
+
+static sim_uart uarts[2];
+
+/** This structure holds the addresses and bits of a timer's registers and the state
+ *  which isn't in them. The count is worked out from the time whenever it's needed,
+ *  so the timer costs nothing while nobody looks at it.
+ */
+struct sim_timer
+    {
+    unsigned int tcnt;                      ///< Address of the count register
+    unsigned int ocr;                       ///< Address of the compare register
+    unsigned int tccr;                      ///< Address of the register with CS bits
+    const unsigned int* prescalers;         ///< Clock dividers for each CS setting
+    unsigned int ctc_reg;                   ///< Address of the register with WGM bits
+    uint8_t ctc_mask;                       ///< Which WGM bits choose the mode
+    uint8_t ctc_bits;                       ///< What those bits are in CTC mode
+    uint8_t ocf;                            ///< Compare match flag and enable bit
+    uint8_t tov;                            ///< Overflow flag and enable bit
+    unsigned int tifr;                      ///< Address of the interrupt flag register
+    unsigned int timsk;                     ///< Address of the interrupt mask register
+    bool wide;                              ///< True for a 16-bit timer
+    sim_vector comp_vect;                   ///< Compare match interrupt routine
+    sim_vector ovf_vect;                    ///< Overflow interrupt routine
+
+    unsigned long long base;                ///< Cycle at which the count was right
+    };
+
+/// These are the clock dividers which Timer 0's CS bits pick on the ATmega128
+static const unsigned int timer0_prescalers[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+/// These are the clock dividers for Timers 1 and 3; external clock settings stop them
+static const unsigned int timer1_prescalers[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+/// These are the simulated timers, in the order of their interrupt vectors. Only
+/// compare match A is simulated for Timers 1 and 3, with CTC mode 4 (top at OCRnA)
+static sim_timer timers[3] =
+    {
+    { 0x4C, 0x4A, 0x4E, timer1_prescalers, 0x4E, _BV (WGM13) | _BV (WGM12),
+      _BV (WGM12), _BV (OCF1A), _BV (TOV1), 0x56, 0x57, true, NULL, NULL, 0 },
+    { 0x52, 0x51, 0x53, timer0_prescalers, 0x53, _BV (WGM01) | _BV (WGM00),
+      _BV (WGM01), _BV (OCF0), _BV (TOV0), 0x56, 0x57, false, NULL, NULL, 0 },
+    { 0x88, 0x86, 0x8A, timer1_prescalers, 0x8A, _BV (WGM33) | _BV (WGM32),
+      _BV (WGM32), _BV (OCF3A), _BV (TOV3), 0x7C, 0x7D, true, NULL, NULL, 0 }
+    };
+
+/// This is the number of timers whose vectors come before USART 0's; Timer 3's
+/// vectors come after the A/D's
+#define SIM_EARLY_TIMERS    2
+
+/// This is the number of simulated timers
+#define SIM_TIMERS          (sizeof (timers) / sizeof (timers[0]))
+
+/// This is used as the time of the next event when nothing is going to happen
+#define NO_EVENT            (~0ULL)
+
+static unsigned long cpu_hz = F_CPU;        ///< Simulated CPU clock frequency
+static unsigned long long cycles = 0;       ///< Cycles since the simulation started
+static unsigned char access_cycles = SIM_ACCESS_CYCLES;
+static unsigned long interrupts = 0;        ///< Number of interrupts which have run
+static unsigned long long sleep_cycles = 0; ///< Cycles spent in sleep mode
+
+/// This is true while the program's instruction which touched a register runs
+static volatile bool in_access = false;
+
+/// These describe the register access which is in progress
+static unsigned int access_offset;
+static bool access_write;
+static uint8_t access_old[2];
+
+/// This counts register accesses since the host timer last looked
+static volatile unsigned long recent_accesses = 0;
+
+/// This is true if the host timer went off while a register access was in progress
+static volatile bool idle_check_pending = false;
+
+
+//-------------------------------------------------------------------------------------
+/** This function turns protection of the I/O page on or off. Whenever program code is
+ *  running it's on, so that register accesses trap; the simulation's own code turns
+ *  it off while it works on the registers.
+ *  @param on True to protect the page, false to allow access
+ */
+
+static void protect (bool on)
+    {
+    mprotect ((void*)sim_io, SIM_IO_SIZE, on ? PROT_NONE : (PROT_READ | PROT_WRITE));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This is the default A/D input: each channel has a sine wave at a different
+ *  frequency, 10 Hz times one more than the channel number, centered at mid scale.
+ *  @param channel The channel being converted
+ *  @param cycle The cycle at which the conversion finishes
+ *  @return A 10-bit reading
+ */
+
+static unsigned int default_source (unsigned char channel, unsigned long long cycle)
+    {
+    double seconds = (double)cycle / (double)cpu_hz;
+    double value = 512.0 + 400.0 * sin (2.0 * M_PI * 10.0 * (channel + 1) * seconds);
+
+    return ((unsigned int)value & 0x03FF);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds the number of CPU cycles the A/D takes for one conversion.
+ *  @return The number of cycles, from the prescaler and whether it's the first one
+ */
+
+static unsigned long adc_conversion_cycles (void)
+    {
+    unsigned char ps_bits = sim_io[0x26] & 0x07;
+    unsigned long prescale = (ps_bits == 0) ? 2 : (1UL << ps_bits);
+
+    return (prescale * (adc.first ? 25 : 13));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function starts an A/D conversion at the given time.
+ *  @param at The cycle at which the conversion starts
+ */
+
+static void adc_start (unsigned long long at)
+    {
+    adc.channel = sim_io[0x27] & 0x1F;
+    adc.done_at = at + adc_conversion_cycles ();
+    adc.first = false;
+    adc.busy = true;
+    sim_io[0x26] |= _BV (ADSC);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds the number of CPU cycles it takes a USART to send or receive
+ *  one character, with a start bit, 8 data bits, and a stop bit.
+ *  @param p_uart The USART
+ *  @return The number of cycles per character
+ */
+
+static unsigned long uart_char_cycles (sim_uart* p_uart)
+    {
+    unsigned long ubrr = ((unsigned long)(sim_io[p_uart->ubrrh] & 0x0F) << 8)
+                         | sim_io[p_uart->ubrrl];
+    unsigned long per_bit = (sim_io[p_uart->ucsra] & _BV (U2X0)) ? 8 : 16;
+
+    return (10 * per_bit * (ubrr + 1));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds the clock divider a timer is using.
+ *  @param p_timer The timer
+ *  @return The number of CPU cycles per count, or 0 if the timer is stopped
+ */
+
+static unsigned long timer_prescale (sim_timer* p_timer)
+    {
+    return (p_timer->prescalers[sim_io[p_timer->tccr] & 0x07]);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds how many counts it will be before something happens to a
+ *  timer: the count reaching the compare value, or going back to zero. In CTC mode
+ *  the count goes back to zero after it matches, unless it was already past the
+ *  compare value, in which case it runs to the top first as the hardware does.
+ *  @param p_timer The timer
+ *  @param count The count now
+ *  @return The number of timer clocks until the next match or wrap
+ */
+
+static unsigned long timer_step (sim_timer* p_timer, unsigned long count)
+    {
+    unsigned long top = p_timer->wide ? 0xFFFF : 0xFF;
+    unsigned long match = p_timer->wide ? *(uint16_t*)(sim_io + p_timer->ocr)
+                                        : sim_io[p_timer->ocr];
+    bool ctc = (sim_io[p_timer->ctc_reg] & p_timer->ctc_mask) == p_timer->ctc_bits;
+
+    if (ctc && count <= match)
+        return (match - count + 1);
+    if (count < match)
+        return (match - count);
+    return (top - count + 1);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function brings a timer's count up to the current time, setting its compare
+ *  match and overflow flags when they would have been set.
+ *  @param p_timer The timer
+ */
+
+static void timer_update (sim_timer* p_timer)
+    {
+    unsigned long prescale = timer_prescale (p_timer);
+
+    if (prescale == 0)
+        {
+        p_timer->base = cycles;
+        return;
+        }
+
+    unsigned long long clocks = (cycles - p_timer->base) / prescale;
+    p_timer->base += clocks * prescale;
+
+    unsigned long match = p_timer->wide ? *(uint16_t*)(sim_io + p_timer->ocr)
+                                        : sim_io[p_timer->ocr];
+    unsigned long top = p_timer->wide ? 0xFFFF : 0xFF;
+    unsigned long count = p_timer->wide ? *(uint16_t*)(sim_io + p_timer->tcnt)
+                                        : sim_io[p_timer->tcnt];
+    bool ctc = (sim_io[p_timer->ctc_reg] & p_timer->ctc_mask) == p_timer->ctc_bits;
+    uint8_t* p_tifr = (uint8_t*)&sim_io[p_timer->tifr];
+
+    while (clocks > 0)
+        {
+        unsigned long step = timer_step (p_timer, count);
+
+        if (clocks < step)
+            {
+            count += clocks;
+            break;
+            }
+        clocks -= step;
+        count += step;
+
+        // Matching in CTC mode, or going past the top, takes the count back to zero
+        if (ctc && count == match + 1)
+            {
+            *p_tifr |= p_timer->ocf;
+            count = 0;
+            }
+        else if (count > top)
+            {
+            *p_tifr |= p_timer->tov;
+            count = 0;
+            }
+        else
+            *p_tifr |= p_timer->ocf;
+        }
+
+    if (p_timer->wide)
+        *(uint16_t*)(sim_io + p_timer->tcnt) = (uint16_t)count;
+    else
+        sim_io[p_timer->tcnt] = (uint8_t)count;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds when a timer will next set one of its flags.
+ *  @param p_timer The timer
+ *  @return The cycle of the next match or wrap, or NO_EVENT if the timer is stopped
+ */
+
+static unsigned long long timer_next_event (sim_timer* p_timer)
+    {
+    unsigned long prescale = timer_prescale (p_timer);
+
+    if (prescale == 0)
+        return (NO_EVENT);
+
+    unsigned long count = p_timer->wide ? *(uint16_t*)(sim_io + p_timer->tcnt)
+                                        : sim_io[p_timer->tcnt];
+    return (p_timer->base + (unsigned long long)timer_step (p_timer, count) * prescale);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function brings the simulated peripherals up to the current time, finishing
+ *  conversions and moving characters in and out of the USART's.
+ */
+
+static void update (void)
+    {
+    for (unsigned char index = 0; index < SIM_TIMERS; index++)
+        timer_update (&timers[index]);
+
+    while (adc.busy && !adc.stalled && cycles >= adc.done_at)
+        {
+        unsigned int value = adc.source (adc.channel, adc.done_at) & 0x03FF;
+
+        if (sim_io[0x27] & _BV (ADLAR))
+            value <<= 6;
+        sim_io[0x24] = (uint8_t)value;
+        sim_io[0x25] = (uint8_t)(value >> 8);
+        sim_io[0x26] |= _BV (ADIF);
+        adc.conversions++;
+
+        // In free running mode the next conversion starts right away
+        if (sim_io[0x26] & _BV (ADFR))
+            adc_start (adc.done_at);
+        else
+            {
+            adc.busy = false;
+            sim_io[0x26] &= ~_BV (ADSC);
+            }
+        }
+
+    for (unsigned char port = 0; port < 2; port++)
+        {
+        sim_uart* p_uart = &uarts[port];
+
+        while (p_uart->tx_busy && cycles >= p_uart->tx_done_at)
+            {
+            if (p_uart->captured < SIM_CAPTURE_SIZE)
+                p_uart->capture[p_uart->captured++] = (char)p_uart->shifter;
+            p_uart->last_tx_at = p_uart->tx_done_at;
+
+            if (p_uart->holding_full)
+                {
+                p_uart->shifter = p_uart->holding;
+                p_uart->holding_full = false;
+                p_uart->tx_done_at += uart_char_cycles (p_uart);
+                sim_io[p_uart->ucsra] |= _BV (UDRE0);
+                }
+            else
+                {
+                p_uart->tx_busy = false;
+                sim_io[p_uart->ucsra] |= _BV (TXC0);
+                }
+            }
+
+        while (p_uart->rx_next < p_uart->rx_queued && cycles >= p_uart->rx_next_at)
+            {
+            if ((sim_io[p_uart->ucsrb] & _BV (RXEN0)) == 0)
+                ;                           // Receiver off; the character is lost
+            else if (sim_io[p_uart->ucsra] & _BV (RXC0))
+                sim_io[p_uart->ucsra] |= _BV (DOR0);
+            else
+                {
+                p_uart->rx_data = (uint8_t)p_uart->p_rx_queue[p_uart->rx_next];
+                sim_io[p_uart->ucsra] |= _BV (RXC0);
+                }
+            p_uart->rx_next++;
+            p_uart->rx_next_at += uart_char_cycles (p_uart);
+            }
+        }
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds which USART, if any, has a register at the given address.
+ *  @param offset The address of the register
+ *  @return A pointer to the USART, or NULL if the register isn't a USART's
+ */
+
+static sim_uart* uart_at (unsigned int offset)
+    {
+    for (unsigned char port = 0; port < 2; port++)
+        {
+        sim_uart* p_uart = &uarts[port];
+
+        if (offset == p_uart->udr || offset == p_uart->ucsra
+            || offset == p_uart->ucsrb || offset == p_uart->ubrrl
+            || offset == p_uart->ubrrh)
+            return (p_uart);
+        }
+    return (NULL);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds which timer, if any, has its count or clock select register
+ *  at the given address. Writing either one makes the timer start counting afresh.
+ *  @param offset The address of the register
+ *  @return A pointer to the timer, or NULL if the register isn't one of those
+ */
+
+static sim_timer* timer_at (unsigned int offset)
+    {
+    for (unsigned char index = 0; index < SIM_TIMERS; index++)
+        {
+        sim_timer* p_timer = &timers[index];
+
+        if (offset == p_timer->tccr || offset == p_timer->tcnt
+            || (p_timer->wide && offset == p_timer->tcnt + 1))
+            return (p_timer);
+        }
+    return (NULL);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function gets a register ready to be read or written. Time moves on by one
+ *  access, and if a USART data register is about to be read, the received character
+ *  is put where the program will find it.
+ *  @param offset The address of the register
+ */
+
+static void before_access (unsigned int offset)
+    {
+    cycles += access_cycles;
+    recent_accesses++;
+    update ();
+
+    sim_uart* p_uart = uart_at (offset);
+    if (p_uart != NULL && offset == p_uart->udr)
+        sim_io[offset] = p_uart->rx_data;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function acts on a register which has just been read or written, doing what
+ *  the hardware would do. Read only bits and bits which are cleared by writing a one
+ *  are put right, since the program's write will have changed them.
+ *  @param offset The address of the register
+ *  @param written True if the register was (or may have been) written
+ *  @param old_value The value of the register before the access
+ */
+
+static void after_access (unsigned int offset, bool written, uint8_t old_value)
+    {
+    uint8_t value = sim_io[offset];
+    sim_uart* p_uart = uart_at (offset);
+
+    if (offset == 0x26 && written)          // ADCSRA
+        {
+        bool start = (value & _BV (ADSC)) != 0;
+
+        // ADIF is cleared by writing a one to it; ADSC can only be cleared by the
+        // hardware, when a conversion is done
+        uint8_t flag = old_value & _BV (ADIF);
+        if (value & _BV (ADIF))
+            flag = 0;
+        value = (value & ~(_BV (ADIF) | _BV (ADSC))) | flag;
+
+        if (!(value & _BV (ADEN)))
+            adc.busy = false;
+        else if (!(old_value & _BV (ADEN)))
+            adc.first = true;
+
+        if (adc.busy)
+            value |= _BV (ADSC);
+        sim_io[offset] = value;
+
+        if (start && (value & _BV (ADEN)) && !adc.busy)
+            adc_start (cycles);
+        }
+    else if ((offset == 0x56 || offset == 0x7C) && written)
+        // TIFR and ETIFR: flags are cleared by writing ones
+        sim_io[offset] = old_value & ~value;
+    else if ((offset == 0x24 || offset == 0x25) && written)
+        sim_io[offset] = old_value;         // ADCL and ADCH are read only
+    else if (p_uart != NULL && offset == p_uart->udr)
+        {
+        if (written)
+            {
+            sim_io[offset] = old_value;
+            if (sim_io[p_uart->ucsrb] & _BV (TXEN0))
+                {
+                if (!p_uart->tx_busy)
+                    {
+                    p_uart->shifter = value;
+                    p_uart->tx_busy = true;
+                    p_uart->tx_done_at = cycles + uart_char_cycles (p_uart);
+                    }
+                else if (!p_uart->holding_full)
+                    {
+                    p_uart->holding = value;
+                    p_uart->holding_full = true;
+                    sim_io[p_uart->ucsra] &= ~_BV (UDRE0);
+                    }
+                }
+            }
+        else                                // Reading UDR takes the character out
+            sim_io[p_uart->ucsra] &= ~(_BV (RXC0) | _BV (DOR0) | _BV (FE0));
+        }
+    else if (written && timer_at (offset) != NULL)
+        timer_at (offset)->base = cycles;   // Counting starts over from now
+    else if (p_uart != NULL && offset == p_uart->ucsra && written)
+        {
+        // Only U2X and MPCM can be written; TXC is cleared by writing a one
+        uint8_t keep = old_value & (_BV (RXC0) | _BV (UDRE0) | _BV (FE0) | _BV (DOR0)
+                                    | _BV (UPE0));
+        if (!(value & _BV (TXC0)))
+            keep |= old_value & _BV (TXC0);
+        sim_io[offset] = keep | (value & (_BV (U2X0) | _BV (MPCM0)));
+        }
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks whether one of a USART's interrupts should be run.
+ *  @param p_uart The USART
+ *  @return The interrupt routine to run, or NULL if none is due
+ */
+
+static sim_vector uart_pending (sim_uart* p_uart)
+    {
+    uint8_t status = sim_io[p_uart->ucsra];
+    uint8_t control = sim_io[p_uart->ucsrb];
+
+    if ((status & _BV (RXC0)) && (control & _BV (RXCIE0)) && p_uart->rx_vect)
+        return (p_uart->rx_vect);
+    if ((status & _BV (UDRE0)) && (control & _BV (UDRIE0)) && p_uart->udre_vect)
+        return (p_uart->udre_vect);
+    if ((status & _BV (TXC0)) && (control & _BV (TXCIE0)) && p_uart->tx_vect)
+        {
+        sim_io[p_uart->ucsra] &= ~_BV (TXC0);   // Cleared when the interrupt runs
+        return (p_uart->tx_vect);
+        }
+    return (NULL);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks whether one of a timer's interrupts should be run. The flag
+ *  is cleared when the interrupt runs, as on the AVR.
+ *  @param p_timer The timer
+ *  @return The interrupt routine to run, or NULL if none is due
+ */
+
+static sim_vector timer_pending (sim_timer* p_timer)
+    {
+    uint8_t flags = sim_io[p_timer->tifr] & sim_io[p_timer->timsk];
+
+    if ((flags & p_timer->ocf) && p_timer->comp_vect)
+        {
+        sim_io[p_timer->tifr] &= ~p_timer->ocf;
+        return (p_timer->comp_vect);
+        }
+    if ((flags & p_timer->tov) && p_timer->ovf_vect)
+        {
+        sim_io[p_timer->tifr] &= ~p_timer->tov;
+        return (p_timer->ovf_vect);
+        }
+    return (NULL);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds the interrupt which should run next, in the order of the
+ *  ATmega128's interrupt vector table. Flags which the hardware clears when the
+ *  interrupt runs are cleared.
+ *  @return The interrupt routine to run, or NULL if none is due
+ */
+
+static sim_vector pending_vector (void)
+    {
+    sim_vector vector;
+
+    for (unsigned char index = 0; index < SIM_EARLY_TIMERS; index++)
+        if ((vector = timer_pending (&timers[index])) != NULL)
+            return (vector);
+
+    if ((vector = uart_pending (&uarts[0])) != NULL)
+        return (vector);
+
+    if ((sim_io[0x26] & _BV (ADIF)) && (sim_io[0x26] & _BV (ADIE)) && sim_vect_adc)
+        {
+        sim_io[0x26] &= ~_BV (ADIF);
+        return (sim_vect_adc);
+        }
+
+    for (unsigned char index = SIM_EARLY_TIMERS; index < SIM_TIMERS; index++)
+        if ((vector = timer_pending (&timers[index])) != NULL)
+            return (vector);
+
+    return (uart_pending (&uarts[1]));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function runs any interrupts which are due, if the I bit in SREG allows it.
+ *  The I bit is cleared while each routine runs, as on the AVR, and the I/O page is
+ *  protected so the routine's register accesses are simulated. It's called with the
+ *  page unprotected, and leaves it that way.
+ */
+
+static void dispatch (void)
+    {
+    sim_vector vector;
+
+    while ((sim_io[0x5F] & 0x80) && (vector = pending_vector ()) != NULL)
+        {
+        sim_io[0x5F] &= ~0x80;
+        interrupts++;
+        cycles += 8;                        // Cycles to enter and return from an ISR
+        protect (true);
+        vector ();
+        protect (false);
+        sim_io[0x5F] |= 0x80;
+        }
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds when the next event will happen: a conversion finishing, a
+ *  character going in or out, or a timer matching or overflowing. 
+ *  @param target The latest time which is of interest
+ *  @return The cycle of the next event, or the target if nothing happens before it
+ */
+
+static unsigned long long next_event (unsigned long long target)
+    {
+    unsigned long long next = target;
+
+    if (adc.busy && !adc.stalled && adc.done_at < next)
+        next = adc.done_at;
+    for (unsigned char port = 0; port < 2; port++)
+        {
+        if (uarts[port].tx_busy && uarts[port].tx_done_at < next)
+            next = uarts[port].tx_done_at;
+        if (uarts[port].rx_next < uarts[port].rx_queued
+            && uarts[port].rx_next_at < next)
+            next = uarts[port].rx_next_at;
+        }
+    for (unsigned char index = 0; index < SIM_TIMERS; index++)
+        {
+        unsigned long long at = timer_next_event (&timers[index]);
+        if (at < next)
+            next = at;
+        }
+
+    return (next);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function moves simulated time forward to the given cycle, stopping at each
+ *  event on the way so that interrupts run when they would on the real chip, not all
+ *  at once at the end. It's called with the I/O page unprotected.
+ *  @param target The cycle to move forward to
+ */
+
+static void run_until (unsigned long long target)
+    {
+    while (cycles < target)
+        {
+        unsigned long long next = next_event (target);
+
+        if (next < cycles)
+            next = cycles;
+
+        cycles = next;
+        update ();
+        dispatch ();
+        }
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This is the handler for the fault which happens when the program touches the I/O
+ *  page. It gets the register ready, unprotects the page, and sets the trap flag so
+ *  that the processor will stop again right after the instruction has run. Faults
+ *  elsewhere are real bugs, so for those the default action is put back and the
+ *  instruction is allowed to fault again.
+ */
+
+static void segv_handler (int, siginfo_t* p_info, void* p_context)
+    {
+    ucontext_t* p_uc = (ucontext_t*)p_context;
+    volatile uint8_t* p_addr = (volatile uint8_t*)p_info->si_addr;
+
+    if (p_addr < sim_io || p_addr >= sim_io + SIM_IO_SIZE)
+        {
+        signal (SIGSEGV, SIG_DFL);
+        return;
+        }
+
+    protect (false);
+    access_offset = (unsigned int)(p_addr - sim_io);
+    access_write = (p_uc->uc_mcontext.gregs[REG_ERR] & FAULT_WRITE) != 0;
+    before_access (access_offset);
+    access_old[0] = sim_io[access_offset];
+    access_old[1] = sim_io[(access_offset + 1) & (SIM_IO_SIZE - 1)];
+
+    in_access = true;
+    p_uc->uc_mcontext.gregs[REG_EFL] |= TRAP_FLAG;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This is the handler for the trap which happens after the instruction which touched
+ *  a register has run. It acts on what the instruction did, runs any interrupts which
+ *  have become due, and protects the page again. The register access might have been
+ *  16 bits wide, so the byte after it is checked for a write as well.
+ */
+
+static void trap_handler (int, siginfo_t*, void* p_context)
+    {
+    ucontext_t* p_uc = (ucontext_t*)p_context;
+
+    p_uc->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+    if (!in_access)
+        return;
+    in_access = false;
+
+    unsigned int next = (access_offset + 1) & (SIM_IO_SIZE - 1);
+
+    after_access (access_offset,
+                  access_write || sim_io[access_offset] != access_old[0],
+                  access_old[0]);
+    if (sim_io[next] != access_old[1])
+        after_access (next, true, access_old[1]);
+
+    idle_check_pending = false;
+    dispatch ();
+    protect (true);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This is the handler for the host timer. If the program hasn't touched a register
+ *  since the last time, it's probably waiting for an interrupt to change a variable,
+ *  so simulated time is moved along and any interrupts which come due are run.
+ */
+
+static void alarm_handler (int)
+    {
+    if (in_access)
+        {
+        idle_check_pending = true;
+        return;
+        }
+
+    if (recent_accesses == 0)
+        {
+        protect (false);
+        run_until (cycles + SIM_IDLE_CYCLES);
+        protect (true);
+        }
+    recent_accesses = 0;
+    }
+
+
+/// This is the set of signals blocked while the simulation's functions run
+static sigset_t alarm_set;
+
+//-------------------------------------------------------------------------------------
+/** This function is called at the start of each of the simulation's public functions.
+ *  It keeps the host timer out and unprotects the I/O page.
+ */
+
+static void enter (void)
+    {
+    sigprocmask (SIG_BLOCK, &alarm_set, NULL);
+    protect (false);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function is called at the end of each of the simulation's public functions.
+ *  It protects the I/O page and lets the host timer back in.
+ */
+
+static void leave (void)
+    {
+    protect (true);
+    sigprocmask (SIG_UNBLOCK, &alarm_set, NULL);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function puts the simulated chip into the state it's in after a reset: all
+ *  registers zero except for the USART's data register empty flags, no interrupts
+ *  enabled, and no characters waiting or captured.
+ *  @param new_cpu_hz The simulated CPU clock frequency in Hz
+ */
+
+void sim_reset (unsigned long new_cpu_hz)
+    {
+    enter ();
+
+    for (unsigned int offset = 0; offset < SIM_IO_SIZE; offset++)
+        sim_io[offset] = 0;
+
+    cpu_hz = new_cpu_hz;
+    cycles = 0;
+    interrupts = 0;
+    sleep_cycles = 0;
+    adc.busy = false;
+    adc.first = true;
+    adc.conversions = 0;
+    adc.stalled = false;
+    if (adc.source == NULL)
+        adc.source = default_source;
+
+    for (unsigned char port = 0; port < 2; port++)
+        {
+        sim_uart* p_uart = &uarts[port];
+
+        free (p_uart->p_rx_queue);
+        memset (p_uart, 0, sizeof (sim_uart));
+        }
+    for (unsigned char index = 0; index < SIM_TIMERS; index++)
+        timers[index].base = 0;
+    timers[0].comp_vect = sim_vect_timer1_compa;
+    timers[0].ovf_vect = sim_vect_timer1_ovf;
+    timers[1].comp_vect = sim_vect_timer0_comp;
+    timers[1].ovf_vect = sim_vect_timer0_ovf;
+    timers[2].comp_vect = sim_vect_timer3_compa;
+    timers[2].ovf_vect = sim_vect_timer3_ovf;
+
+    uarts[0].udr = 0x2C;
+    uarts[0].ucsra = 0x2B;
+    uarts[0].ucsrb = 0x2A;
+    uarts[0].ubrrl = 0x29;
+    uarts[0].ubrrh = 0x90;
+    uarts[0].rx_vect = sim_vect_usart0_rx;
+    uarts[0].udre_vect = sim_vect_usart0_udre;
+    uarts[0].tx_vect = sim_vect_usart0_tx;
+    uarts[1].udr = 0x9C;
+    uarts[1].ucsra = 0x9B;
+    uarts[1].ucsrb = 0x9A;
+    uarts[1].ubrrl = 0x99;
+    uarts[1].ubrrh = 0x98;
+    uarts[1].rx_vect = sim_vect_usart1_rx;
+    uarts[1].udre_vect = sim_vect_usart1_udre;
+    uarts[1].tx_vect = sim_vect_usart1_tx;
+    sim_io[0x2B] = _BV (UDRE0);
+    sim_io[0x9B] = _BV (UDRE1);
+
+    leave ();
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function sets up the simulation before main() runs. It installs the signal
+ *  handlers, resets the simulated chip, and starts the host timer.
+ */
+
+static void __attribute__ ((constructor (101))) sim_startup (void)
+    {
+    static char signal_stack[SIGNAL_STACK_SIZE];
+    struct sigaction action;
+    stack_t handler_stack;
+
+    sigemptyset (&alarm_set);
+    sigaddset (&alarm_set, SIGALRM);
+
+    // The handlers run on a stack of their own, so that the program's stack only
+    // holds what the program itself puts there
+    handler_stack.ss_sp = signal_stack;
+    handler_stack.ss_size = sizeof (signal_stack);
+    handler_stack.ss_flags = 0;
+    sigaltstack (&handler_stack, NULL);
+
+    // The fault and trap handlers must be able to interrupt each other, since
+    // interrupt routines run from the trap handler touch registers too
+    memset (&action, 0, sizeof (action));
+    action.sa_sigaction = segv_handler;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER | SA_RESTART | SA_ONSTACK;
+    action.sa_mask = alarm_set;
+    sigaction (SIGSEGV, &action, NULL);
+    action.sa_sigaction = trap_handler;
+    sigaction (SIGTRAP, &action, NULL);
+
+    memset (&action, 0, sizeof (action));
+    action.sa_handler = alarm_handler;
+    action.sa_flags = SA_RESTART | SA_ONSTACK;
+    sigemptyset (&action.sa_mask);
+    sigaction (SIGALRM, &action, NULL);
+
+    sim_reset (F_CPU);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = IDLE_CHECK_US;
+    timer.it_value = timer.it_interval;
+    setitimer (ITIMER_REAL, &timer, NULL);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function returns the simulated CPU clock frequency.
+ *  @return The frequency in Hz
+ */
+
+unsigned long sim_cpu_hz (void)
+    {
+    return (cpu_hz);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function returns the simulated time.
+ *  @return The number of CPU cycles since the simulation was last reset
+ */
+
+unsigned long long sim_cycles (void)
+    {
+    return (cycles);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function moves simulated time forward, as if the program had spent that long
+ *  doing work which doesn't touch any registers. Interrupts which come due are run.
+ *  @param count The number of cycles to move forward
+ */
+
+void sim_advance (unsigned long count)
+    {
+    enter ();
+    run_until (cycles + count);
+    leave ();
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function is what the SLEEP instruction does. If sleeping has been enabled in
+ *  MCUCR, simulated time moves on to the next event, and the next, until one of them
+ *  runs an interrupt, which wakes the processor up. If interrupts are off or nothing
+ *  is going to happen, the processor would sleep forever; the simulation wakes it
+ *  straight away instead.
+ */
+
+void sim_sleep (void)
+    {
+    enter ();
+
+    if ((sim_io[0x55] & _BV (SE)) && (sim_io[0x5F] & 0x80))
+        {
+        unsigned long before = interrupts;
+
+        while (interrupts == before)
+            {
+            unsigned long long next = next_event (NO_EVENT);
+
+            if (next == NO_EVENT)
+                break;
+            sleep_cycles += (next > cycles) ? next - cycles : 0;
+            run_until (next > cycles ? next : cycles + 1);
+            }
+        }
+
+    leave ();
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function returns the number of cycles the processor has spent asleep.
+ *  @return The number of sleeping cycles since the simulation was last reset
+ */
+
+unsigned long long sim_sleep_cycles (void)
+    {
+    return (sleep_cycles);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function sets the number of cycles each register access takes.
+ *  @param count The number of cycles
+ */
+
+void sim_set_access_cycles (unsigned char count)
+    {
+    access_cycles = count;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function returns the number of interrupt routines which have been run.
+ *  @return The number of interrupts since the simulation was last reset
+ */
+
+unsigned long sim_interrupts (void)
+    {
+    return (interrupts);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function sets the function which gives the A/D converter's input voltages.
+ *  @param source The function, or NULL to go back to the default sine waves
+ */
+
+void sim_adc_set_source (sim_adc_source source)
+    {
+    adc.source = (source != NULL) ? source : default_source;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function stops the A/D converter finishing conversions, as if it were broken,
+ *  so that the drivers' timeouts can be checked. ADSC stays set on the conversion
+ *  which is running, or the next one started, until the converter is let go again.
+ *  @param stall True to stop conversions finishing, false to let them go on
+ */
+
+void sim_adc_stall (bool stall)
+    {
+    adc.stalled = stall;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function returns the number of A/D conversions which have been finished.
+ *  @return The number of conversions since the simulation was last reset
+ */
+
+unsigned long sim_adc_conversions (void)
+    {
+    return (adc.conversions);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function sends characters to a USART's receiver, as if they came over the
+ *  serial line at the USART's baud rate, starting one character time from now.
+ *  @param port The USART number, 0 or 1
+ *  @param p_data The characters
+ *  @param length The number of characters
+ */
+
+void sim_uart_inject (unsigned char port, const char* p_data, unsigned int length)
+    {
+    sim_uart* p_uart = &uarts[port & 0x01];
+
+    enter ();
+    if (p_uart->rx_next >= p_uart->rx_queued)
+        {
+        p_uart->rx_next = 0;
+        p_uart->rx_queued = 0;
+        p_uart->rx_next_at = cycles + uart_char_cycles (p_uart);
+        }
+    p_uart->p_rx_queue = (char*)realloc (p_uart->p_rx_queue,
+                                         p_uart->rx_queued + length);
+    memcpy (p_uart->p_rx_queue + p_uart->rx_queued, p_data, length);
+    p_uart->rx_queued += length;
+    leave ();
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function gets the characters a USART has sent.
+ *  @param port The USART number, 0 or 1
+ *  @param pp_data A pointer to a pointer which is set to point to the characters
+ *  @return The number of characters
+ */
+
+unsigned int sim_uart_captured (unsigned char port, const char** pp_data)
+    {
+    *pp_data = uarts[port & 0x01].capture;
+    return (uarts[port & 0x01].captured);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function returns the time at which a USART finished sending its most recent
+ *  character.
+ *  @param port The USART number, 0 or 1
+ *  @return The cycle at which the last stop bit went out
+ */
+
+unsigned long long sim_uart_last_cycle (unsigned char port)
+    {
+    return (uarts[port & 0x01].last_tx_at);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function throws away the characters a USART has sent so far.
+ *  @param port The USART number, 0 or 1
+ */
+
+void sim_uart_clear (unsigned char port)
+    {
+    uarts[port & 0x01].captured = 0;
+    }
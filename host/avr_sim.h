@@ -0,0 +1,83 @@
+//*************************************************************************************
+/** \file avr_sim.h
+ *        This file contains the interface to a simulation of the ATmega128's A/D
+ *        converter, USART's and timers which lets the drivers in this project run on
+ *        a Linux PC. The headers in this directory stand in for avr-libc's
+ *        <avr/io.h>, <avr/interrupt.h>, <avr/sleep.h> and <util/crc16.h>, so the
+ *        driver source files compile without any changes when this directory is put
+ *        first in the include path.
+ *
+ *        The I/O registers live in one page of memory which is normally protected,
+ *        so every time the program reads or writes a register the processor traps.
+ *        The trap handler brings the simulated peripherals up to date, lets the one
+ *        instruction which touched the register run, then looks at what was written
+ *        and acts on it, just as the hardware would: writing ADSC starts a
+ *        conversion, writing UDRn starts sending a character, and so on. Interrupts
+ *        whose flags and enable bits are set are run as soon as the I bit in SREG
+ *        allows it. This only works on x86-64 Linux, where the trap flag can be used
+ *        to step over the instruction which touched the register.
+ *
+ *        Simulated time is counted in CPU cycles. Each register access uses up
+ *        sim_access_cycles cycles, which is about what a tight polling loop takes on
+ *        an AVR. If the program spins for a while without touching any registers,
+ *        such as when it waits for an interrupt routine to change a variable, a
+ *        host timer moves simulated time along so that the wait will end.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _AVR_SIM_H_
+#define _AVR_SIM_H_
+
+#include <stdint.h>
+
+
+/// This is the size of the simulated I/O register space; it's one page of memory
+#define SIM_IO_SIZE         4096
+
+/// This is the number of simulated cycles used by each register access by default
+#define SIM_ACCESS_CYCLES   5
+
+/// This is the number of cycles which pass each time the host timer finds the program
+/// spinning without touching registers
+#define SIM_IDLE_CYCLES     1000
+
+/// This is the largest number of characters captured from each simulated USART
+#define SIM_CAPTURE_SIZE    65536
+
+
+/// This is the memory which holds the simulated I/O registers
+extern volatile uint8_t sim_io[SIM_IO_SIZE];
+
+/** This type of function supplies the voltage on an A/D input. It's given the channel
+ *  (the MUX bits from ADMUX) and the cycle at which the conversion finishes, and it
+ *  returns a 10-bit reading.
+ */
+typedef unsigned int (*sim_adc_source) (unsigned char, unsigned long long);
+
+
+// These functions set up the simulation and control simulated time
+void sim_reset (unsigned long cpu_hz);
+unsigned long sim_cpu_hz (void);
+unsigned long long sim_cycles (void);
+void sim_advance (unsigned long cycles);
+void sim_set_access_cycles (unsigned char cycles);
+unsigned long sim_interrupts (void);
+void sim_sleep (void);
+unsigned long long sim_sleep_cycles (void);
+
+// These functions control and measure the simulated A/D converter
+void sim_adc_set_source (sim_adc_source source);
+void sim_adc_stall (bool stall);
+unsigned long sim_adc_conversions (void);
+
+// These functions feed characters to and collect characters from the USART's
+void sim_uart_inject (unsigned char port, const char* p_data, unsigned int length);
+unsigned int sim_uart_captured (unsigned char port, const char** pp_data);
+unsigned long long sim_uart_last_cycle (unsigned char port);
+void sim_uart_clear (unsigned char port);
+
+#endif  // _AVR_SIM_H_
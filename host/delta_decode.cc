@@ -0,0 +1,232 @@
+//*************************************************************************************
+/** \file delta_decode.cc
+ *        This program runs on a PC and decodes the compressed scans sent by
+ *        delta_frame_writer. It reads the raw bytes which came over the serial line
+ *        from a file, or from standard input if no file is named, and prints each
+ *        scan as a line of samples. Frames are found by the zeros which end them,
+ *        COBS decoded, and checked against their CRC. A frame which is damaged, or
+ *        which comes after a gap in the sequence numbers, can't be decoded, and the
+ *        frames after it are skipped until a key frame comes. Frames of other types
+ *        are skipped. A count of frames, scans, and errors is printed at the end on
+ *        standard error. Build it with 'make host' and run
+ *        host/delta_decode [file].
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <util/crc16.h>
+#include "delta_frame.h"
+
+
+/// This is the largest encoded frame which is looked at; longer ones are damaged
+#define MAX_ENCODED         (FRAME_MAX_PAYLOAD + 8)
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds what the decoder knows about the stream.
+ */
+
+typedef struct
+    {
+    bool in_step;                           ///< True if the last samples are known
+    unsigned char next_sequence;            ///< The sequence number expected next
+    unsigned int last_sample[8];            ///< The last sample from each channel
+    unsigned long frames;                   ///< Good frames of compressed scans
+    unsigned long scans;                    ///< Scans printed
+    unsigned long bad_frames;               ///< Frames with bad encoding or checksums
+    unsigned long skipped;                  ///< Good frames skipped to wait for a key
+    } decoder;
+
+
+//-------------------------------------------------------------------------------------
+/** This function undoes the COBS encoding of one frame. Each code byte is one more
+ *  than the number of nonzero bytes after it, and a zero goes between each run.
+ *  @param p_in The encoded frame, not counting the zero at the end
+ *  @param in_length The number of encoded bytes
+ *  @param p_out A buffer for the decoded frame, at least in_length bytes long
+ *  @return The number of decoded bytes, or -1 if the encoding is bad
+ */
+
+static int cobs_decode (const unsigned char* p_in, int in_length, unsigned char* p_out)
+    {
+    int out_length = 0;
+
+    for (int index = 0; index < in_length; )
+        {
+        int code = p_in[index++];
+
+        if (code == 0 || index + code - 1 > in_length)
+            return (-1);
+        for (int count = 1; count < code; count++)
+            p_out[out_length++] = p_in[index++];
+        if (index < in_length)
+            p_out[out_length++] = 0;
+        }
+
+    return (out_length);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads one varint from a frame.
+ *  @param p_data The frame
+ *  @param length The number of bytes in the frame, not counting the checksum
+ *  @param index The place in the frame to start reading, which is moved past it
+ *  @param number A reference to the place to put the number
+ *  @return True if a whole varint was read, false if the frame ended first
+ */
+
+static bool read_varint (const unsigned char* p_data, int length, int& index,
+                         unsigned long& number)
+    {
+    number = 0;
+    for (int shift = 0; index < length && shift < 32; shift += 7)
+        {
+        unsigned char byte = p_data[index++];
+
+        number |= (unsigned long)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return (true);
+        }
+
+    return (false);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function decodes one frame, whose checksum has been checked, and prints the
+ *  scans in it.
+ *  @param p_dec A pointer to the decoder's state
+ *  @param p_frame The frame, starting with the type byte
+ *  @param length The number of bytes in the frame, not counting the checksum
+ */
+
+static void decode_frame (decoder* p_dec, const unsigned char* p_frame, int length)
+    {
+    if (length < 4 || p_frame[0] != FRAME_DELTA)
+        return;
+
+    unsigned char sequence = p_frame[1];
+    unsigned char mask = p_frame[2];
+    bool key = (p_frame[3] & DELTA_KEY_FLAG) != 0;
+    unsigned char channels = 0;
+
+    for (unsigned char bit = 0x01; bit != 0; bit <<= 1)
+        if (mask & bit)
+            channels++;
+
+    // A frame which isn't the next one in the sequence means one was lost
+    if (sequence != p_dec->next_sequence)
+        p_dec->in_step = false;
+    p_dec->next_sequence = sequence + 1;
+
+    if (key)
+        {
+        for (unsigned char index = 0; index < 8; index++)
+            p_dec->last_sample[index] = 0;
+        p_dec->in_step = true;
+        }
+    if (!p_dec->in_step || channels == 0)
+        {
+        p_dec->skipped++;
+        return;
+        }
+
+    p_dec->frames++;
+    for (int index = 4; index < length; )
+        {
+        unsigned int scan[8];
+
+        for (unsigned char channel = 0; channel < channels; channel++)
+            {
+            unsigned long zigzag;
+
+            if (!read_varint (p_frame, length, index, zigzag))
+                {
+                p_dec->in_step = false;
+                p_dec->bad_frames++;
+                return;
+                }
+
+            long delta = (long)(zigzag >> 1) ^ -(long)(zigzag & 1);
+            p_dec->last_sample[channel] += (unsigned int)delta;
+            scan[channel] = p_dec->last_sample[channel] & 0xFFFF;
+            }
+
+        for (unsigned char channel = 0; channel < channels; channel++)
+            printf (channel == 0 ? "%u" : " %u", scan[channel]);
+        printf ("\n");
+        p_dec->scans++;
+        }
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** The main function reads the stream, a frame at a time, and decodes each frame.
+ *  @param argc The number of words on the command line
+ *  @param argv The words on the command line; the second, if any, is the file to read
+ *  @return 0 if everything went well, 1 if the file couldn't be opened
+ */
+
+int main (int argc, char** argv)
+    {
+    FILE* p_file = stdin;
+
+    if (argc > 1 && (p_file = fopen (argv[1], "rb")) == NULL)
+        {
+        perror (argv[1]);
+        return (1);
+        }
+
+    decoder dec = { false, 0, { 0 }, 0, 0, 0, 0 };
+    unsigned char encoded[MAX_ENCODED];
+    unsigned char frame[MAX_ENCODED];
+    int count = 0;
+    int in_byte;
+
+    while ((in_byte = getc (p_file)) != EOF)
+        {
+        if (in_byte != 0)
+            {
+            if (count < MAX_ENCODED)
+                encoded[count] = (unsigned char)in_byte;
+            count++;
+            continue;
+            }
+
+        // A zero ends a frame; decode it and check the checksum, high byte first
+        int length = (count <= MAX_ENCODED) ? cobs_decode (encoded, count, frame) : -1;
+        count = 0;
+
+        if (length < 3)
+            {
+            dec.bad_frames++;
+            dec.in_step = false;
+            continue;
+            }
+
+        unsigned int crc = 0xFFFF;
+        for (int index = 0; index < length - 2; index++)
+            crc = _crc_ccitt_update (crc, frame[index]);
+        if (frame[length - 2] != (unsigned char)(crc >> 8)
+            || frame[length - 1] != (unsigned char)crc)
+            {
+            dec.bad_frames++;
+            dec.in_step = false;
+            continue;
+            }
+
+        decode_frame (&dec, frame, length - 2);
+        }
+
+    fprintf (stderr, "%lu frames, %lu scans, %lu bad frames, %lu frames skipped\n",
+             dec.frames, dec.scans, dec.bad_frames, dec.skipped);
+
+    if (p_file != stdin)
+        fclose (p_file);
+
+    return (0);
+    }
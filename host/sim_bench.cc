@@ -0,0 +1,625 @@
+//*************************************************************************************
+/** \file sim_bench.cc
+ *        This program runs the A/D and serial port drivers on a PC, against the
+ *        simulated ATmega128 in avr_sim.cc, and measures how long the sampling and
+ *        serial paths take in simulated CPU cycles. Build it with 'make host' and run
+ *        host/sim_bench.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "rs232.h"
+#include "rs232_port.h"
+#include "avr_adc.h"
+#include "binary_frame.h"
+#include "delta_frame.h"
+#include "task_scheduler.h"
+#include "text_buffer.h"
+#include "mem_monitor.h"
+#include "avr_sim.h"
+
+
+/// This is the baud rate setting used by adc_test, 9600 baud
+typedef uart_baud<F_CPU, 9600> bench_baud;
+
+/// This is a fast rate for the telemetry link, which 8 MHz can make exactly
+typedef uart_baud<F_CPU, 500000> fast_baud;
+
+/// This is the serial port used by adc_test
+#define PORT                1
+
+
+//-------------------------------------------------------------------------------------
+/** This function converts a number of simulated cycles into microseconds.
+ *  @param count The number of cycles
+ *  @return The time in microseconds
+ */
+
+static double usec (unsigned long long count)
+    {
+    return ((double)count * 1.0e6 / (double)sim_cpu_hz ());
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function lets simulated time pass until the serial port has sent everything
+ *  it's going to send.
+ */
+
+static void wait_for_serial (void)
+    {
+    const char* p_data;
+    unsigned int count;
+
+    do
+        {
+        count = sim_uart_captured (PORT, &p_data);
+        sim_advance (20000);
+        }
+    while (sim_uart_captured (PORT, &p_data) != count);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This task is run by the scheduler benchmark. It records the time at which it ran,
+ *  so the spacing of the runs can be checked, and takes an A/D reading.
+ *  @param p_data A pointer to the A/D converter
+ */
+
+static unsigned long long task_times[2];
+static unsigned long task_runs = 0;
+
+static void bench_task (void* p_data)
+    {
+    ((avr_adc*)p_data)->read_once (0);
+    task_times[task_runs == 0 ? 0 : 1] = sim_cycles ();
+    task_runs++;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function gives a steady A/D input which is different on each channel, so a
+ *  reading shows which channel it came from.
+ *  @param channel The A/D channel being read
+ *  @param cycle The simulated cycle at which the conversion finishes
+ *  @return The reading, 100 times the channel plus 50
+ */
+
+static unsigned int channel_source (unsigned char channel, unsigned long long cycle)
+    {
+    (void)cycle;
+    return (channel * 100 + 50);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function gives slowly changing A/D inputs, like those from temperature or
+ *  pressure sensors: a slow wave a few tenths of a hertz on each channel, plus a
+ *  little noise.
+ *  @param channel The A/D channel being read
+ *  @param cycle The simulated cycle at which the conversion finishes
+ *  @return The reading
+ */
+
+static unsigned int slow_source (unsigned char channel, unsigned long long cycle)
+    {
+    double seconds = (double)cycle / (double)sim_cpu_hz ();
+    double value = 512.0 + 300.0 * sin (2.0 * M_PI * 0.2 * (channel + 1) * seconds);
+
+    return ((unsigned int)value + (unsigned int)((cycle >> 4) % 3));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function gives a steady A/D input of 512 with noise on it, and now and then a
+ *  spike to full scale, to see how well the filters clean it up.
+ *  @param channel The A/D channel being read, which doesn't matter
+ *  @param cycle The simulated cycle at which the conversion finishes
+ *  @return The reading
+ */
+
+static unsigned int noisy_source (unsigned char channel, unsigned long long cycle)
+    {
+    static unsigned long seed = 12345;
+
+    (void)channel;
+    (void)cycle;
+    seed = seed * 1103515245UL + 12345UL;
+    unsigned int noise = (unsigned int)(seed >> 16) & 0x3FF;
+
+    if (noise < 10)
+        return (1023);
+    return (512 - 16 + noise % 33);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function is called by the A/D interrupt routine when a reading begun with
+ *  avr_adc::start() is done. It counts the readings.
+ *  @param value The reading, which isn't used
+ *  @param p_data A pointer to the count
+ */
+
+static void count_reading (unsigned int value, void* p_data)
+    {
+    (void)value;
+    (*(unsigned long*)p_data)++;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** The main function runs each of the benchmarks and prints the results.
+ *  @param argc The number of words on the command line
+ *  @param argv The words on the command line; if there's a second, the compressed
+ *      stream is saved in the file it names, to be read with host/delta_decode
+ */
+
+int main (int argc, char** argv)
+    {
+    mem_monitor memory;
+    rs232 the_serial_port (bench_baud (), PORT);
+    avr_adc my_adc (&the_serial_port);
+    sei ();
+
+    printf ("Simulated ATmega128 at %lu Hz\n\n", sim_cpu_hz ());
+
+    // Blocking single conversions, one after another
+    const unsigned int reads = 200;
+    unsigned long long start = sim_cycles ();
+    for (unsigned int count = 0; count < reads; count++)
+        my_adc.read_once (count & 0x03);
+    unsigned long long elapsed = sim_cycles () - start;
+    printf ("read_once():        %8.1f us per conversion, %7.0f samples/s\n",
+            usec (elapsed) / reads, reads * 1.0e6 / usec (elapsed));
+
+    // Split phase conversions: other work runs between start() and result()
+    unsigned long called = 0;
+    unsigned long long work = 0;
+    my_adc.set_callback (count_reading, &called);
+    start = sim_cycles ();
+    for (unsigned int count = 0; count < reads; count++)
+        {
+        my_adc.start (count & 0x03);
+        while (!my_adc.ready ())
+            {
+            unsigned long long before = sim_cycles ();
+            sim_advance (100);                  // Stands for 100 cycles of other work
+            work += sim_cycles () - before;
+            }
+        if (my_adc.result () > 1023)
+            break;
+        }
+    elapsed = sim_cycles () - start;
+    my_adc.set_callback (NULL, NULL);
+    printf ("start()/ready():    %8.1f us per conversion, %5.1f%% left for work, "
+            "%lu callbacks, %u timeouts\n", usec (elapsed) / reads,
+            100.0 * work / elapsed, called, my_adc.timeouts ());
+
+    // A one-shot scan and then at once a reading of a channel the scan didn't cover;
+    // the conversion the scan left running mustn't be taken for the reading
+    const unsigned int checks = 20;
+    unsigned int wrong_channel = 0;
+    unsigned int check_frame[4];
+    sim_adc_set_source (channel_source);
+    for (unsigned int count = 0; count < checks; count++)
+        {
+        my_adc.start_scan (0x0F, check_frame, false);
+        while (!my_adc.frame_ready ())
+            sim_advance (100);
+        if (my_adc.read_once (5) != channel_source (5, 0))
+            wrong_channel++;
+        my_adc.next_frame ();
+        }
+    sim_adc_set_source (NULL);
+    printf ("scan then read:     %u of %u readings from the wrong channel\n",
+            wrong_channel, checks);
+
+    // Free running conversions collected by the ISR while the CPU does other work
+    unsigned int batch[ADC_BUFFER_SIZE];
+    unsigned long samples = 0;
+    my_adc.start_streaming (0);
+    start = sim_cycles ();
+    while (sim_cycles () - start < sim_cpu_hz () / 10)
+        {
+        sim_advance (1000);
+        samples += my_adc.read_samples (batch, ADC_BUFFER_SIZE);
+        }
+    elapsed = sim_cycles () - start;
+    my_adc.stop ();
+    printf ("streaming:          %8.1f us per conversion, %7.0f samples/s, "
+            "%u overruns\n", usec (elapsed) / samples, samples * 1.0e6 / usec (elapsed),
+            my_adc.overruns ());
+
+    // Streaming at rates set by the timer, measured over one simulated second
+    static const unsigned int rates[] = { 1000, 7777 };
+    for (unsigned char index = 0; index < 2; index++)
+        {
+        my_adc.set_sample_rate (rates[index]);
+        unsigned int lost = my_adc.overruns ();
+        samples = 0;
+        my_adc.start_streaming (0);
+        start = sim_cycles ();
+        while (sim_cycles () - start < sim_cpu_hz ())
+            {
+            sim_advance (1000);
+            samples += my_adc.read_samples (batch, ADC_BUFFER_SIZE);
+            }
+        my_adc.stop ();
+        printf ("timed %4u Hz:      %8lu samples/s, timer gives %u Hz, %+ld ppm, "
+                "%u overruns\n", rates[index], samples, my_adc.achieved_rate (),
+                my_adc.rate_error_ppm (), my_adc.overruns () - lost);
+        }
+    my_adc.set_sample_rate (0);
+
+    // Streaming again, with 16 conversions added up in the ISR for each 12-bit sample
+    my_adc.set_oversampling (2);
+    unsigned long oversampled = 0;
+    unsigned int last_sample = 0;
+    my_adc.start_streaming (0);
+    start = sim_cycles ();
+    while (sim_cycles () - start < sim_cpu_hz () / 10)
+        {
+        sim_advance (1000);
+        unsigned char count = my_adc.read_samples (batch, ADC_BUFFER_SIZE);
+        if (count > 0)
+            last_sample = batch[count - 1];
+        oversampled += count;
+        }
+    elapsed = sim_cycles () - start;
+    my_adc.stop ();
+    printf ("oversampled x16:    %8.1f us per sample,     %7.0f samples/s, "
+            "%u bits, last %u\n", usec (elapsed) / oversampled,
+            oversampled * 1.0e6 / usec (elapsed), my_adc.resolution (), last_sample);
+    my_adc.set_oversampling (0);
+
+    // The text report, sent with blocking putchar()
+    wait_for_serial ();
+    sim_uart_clear (PORT);
+    start = sim_cycles ();
+    the_serial_port << my_adc;
+    elapsed = sim_cycles () - start;
+    const char* p_data;
+    unsigned int text_bytes = sim_uart_captured (PORT, &p_data);
+    printf ("text report:        %8.0f us blocked, %u bytes\n", usec (elapsed),
+            text_bytes);
+
+    // Numbers printed by the virtual rs232 class and by the template port class,
+    // which should send exactly the same text
+    char virtual_text[128];
+    wait_for_serial ();
+    sim_uart_clear (PORT);
+    the_serial_port << "N " << 1234U << " " << -56 << " " << 78901UL << " " << hex
+                    << 0xBEEFU << dec << " " << true << endl;
+    wait_for_serial ();
+    unsigned int virtual_bytes = sim_uart_captured (PORT, &p_data);
+    memcpy (virtual_text, p_data, virtual_bytes);
+    sim_uart_clear (PORT);
+    {
+    bench_baud setting;
+    rs232_port<PORT> direct_port (setting);
+    direct_port << "N " << 1234U << " " << -56 << " " << 78901UL << " " << hex
+                << 0xBEEFU << dec << " " << true << endl;
+    }
+    wait_for_serial ();
+    unsigned int direct_bytes = sim_uart_captured (PORT, &p_data);
+    bool same = (direct_bytes == virtual_bytes
+                 && memcmp (virtual_text, p_data, direct_bytes) == 0);
+    printf ("rs232_port<%u>:      %u bytes, %s\n", PORT, direct_bytes,
+            same ? "same text as rs232" : "different text from rs232");
+
+    // The same report through the interrupt driven transmitter buffer
+    wait_for_serial ();
+    the_serial_port.use_tx_buffer (TX_BLOCK);
+    sim_uart_clear (PORT);
+    start = sim_cycles ();
+    the_serial_port << my_adc;
+    elapsed = sim_cycles () - start;
+    wait_for_serial ();
+    printf ("buffered report:    %8.0f us blocked, %8.0f us until sent\n",
+            usec (elapsed), usec (sim_uart_last_cycle (PORT) - start));
+
+    // The same report put together in RAM first, then passed on in one burst
+    text_buffer report;
+    unsigned long before = report.get_passed_on ();
+    start = sim_cycles ();
+    report << my_adc;
+    elapsed = sim_cycles () - start;
+    unsigned long formatted = report.get_passed_on () - before + report.get_length ();
+    report.clear ();
+    report.add_output (&the_serial_port);
+    wait_for_serial ();
+    sim_uart_clear (PORT);
+    unsigned long long burst = sim_cycles ();
+    report << my_adc << send_now;
+    burst = sim_cycles () - burst;
+    wait_for_serial ();
+    printf ("text_buffer report: %8.0f us composing,  %8.0f us blocked, %lu bytes, "
+            "%u sent\n", usec (elapsed), usec (burst), formatted,
+            sim_uart_captured (PORT, &p_data));
+
+    // The same report sent on the other port at a fast rate with double speed mode
+    {
+    rs232 fast_port (fast_baud (), 1 - PORT);
+    sim_uart_clear (1 - PORT);
+    start = sim_cycles ();
+    fast_port << my_adc;
+    elapsed = sim_cycles () - start;
+    printf ("report at %lu:  %8.0f us blocked, %u bytes, divisor %u%s, %+.1f%%\n",
+            fast_baud::ACTUAL_BAUD, usec (elapsed), sim_uart_captured (1 - PORT, &p_data),
+            fast_baud::DIVISOR, fast_baud::DOUBLE_SPEED ? " with U2X" : "",
+            fast_baud::ERROR_TENTHS / 10.0);
+    }
+
+    // A binary frame holding the same four channels
+    binary_frame_writer writer (&the_serial_port);
+    unsigned int frame[4];
+    my_adc.start_scan (0x0F, frame, false);
+    while (!my_adc.frame_ready ())
+        sim_advance (100);
+    sim_uart_clear (PORT);
+    start = sim_cycles ();
+    writer.send_samples (0x0F, frame);
+    elapsed = sim_cycles () - start;
+    wait_for_serial ();
+    unsigned int frame_bytes = sim_uart_captured (PORT, &p_data);
+    printf ("binary frame:       %8.0f us blocked, %u bytes (%.1fx smaller)\n",
+            usec (elapsed), frame_bytes, (double)text_bytes / frame_bytes);
+
+    // Blocks of 13-bit oversampled samples, each sent from where it is as one frame
+    unsigned int blocks = 0, block_bytes = 0;
+    unsigned long blocked = 0;
+    my_adc.set_oversampling (3);
+    my_adc.start_blocks (0);
+    sim_uart_clear (PORT);
+    unsigned long long cpu_start = sim_cycles ();
+    while (sim_cycles () - cpu_start < sim_cpu_hz ())
+        {
+        unsigned char length;
+        const unsigned int* p_block = my_adc.get_block (length);
+
+        if (p_block == NULL)
+            sim_advance (1000);
+        else
+            {
+            start = sim_cycles ();
+            writer.send_block (0, my_adc.resolution (), p_block, length);
+            blocked += sim_cycles () - start;
+            my_adc.release_block ();
+            blocks++;
+            }
+        }
+    my_adc.stop ();
+    my_adc.set_oversampling (0);
+    wait_for_serial ();
+    block_bytes = sim_uart_captured (PORT, &p_data);
+    printf ("block frames:       %8.0f us blocked per block, %u blocks, %u bytes, "
+            "%u overruns\n", usec (blocked) / blocks, blocks, block_bytes,
+            my_adc.overruns ());
+
+    // Slowly changing inputs scanned 100 times a second for 5 seconds and sent as
+    // compressed differences; text_buffer objects with no ports count the bytes the
+    // same scans would take as text and as one binary frame per scan
+    sim_adc_set_source (slow_source);
+    delta_frame_writer delta_writer (&the_serial_port, 0x0F);
+    text_buffer as_text, as_frames;
+    binary_frame_writer frame_counter (&as_frames);
+    unsigned long scans = 0;
+    my_adc.set_sample_rate (400);
+    my_adc.start_scan (0x0F, frame, true);
+    sim_uart_clear (PORT);
+    cpu_start = sim_cycles ();
+    while (sim_cycles () - cpu_start < 5 * sim_cpu_hz ())
+        {
+        if (!my_adc.frame_ready ())
+            {
+            sim_advance (1000);
+            continue;
+            }
+        delta_writer.add_scan (frame);
+        as_text << frame[0] << " " << frame[1] << " " << frame[2] << " " << frame[3]
+                << endl;
+        frame_counter.send_samples (0x0F, frame);
+        my_adc.next_frame ();
+        scans++;
+        }
+    my_adc.stop ();
+    my_adc.set_sample_rate (0);
+    delta_writer.flush ();
+    wait_for_serial ();
+    sim_adc_set_source (NULL);
+    unsigned int delta_bytes = sim_uart_captured (PORT, &p_data);
+    unsigned long text_total = as_text.get_passed_on () + as_text.get_length ();
+    unsigned long frame_total = as_frames.get_passed_on () + as_frames.get_length ();
+    printf ("delta frames:       %8.2f bytes per scan, %lu scans; %.1fx smaller than "
+            "text, %.1fx than frames\n", (double)delta_bytes / scans, scans,
+            (double)text_total / delta_bytes, (double)frame_total / delta_bytes);
+    if (argc > 1)
+        {
+        FILE* p_file = fopen (argv[1], "wb");
+
+        if (p_file != NULL)
+            {
+            fwrite (p_data, 1, delta_bytes, p_file);
+            fclose (p_file);
+            }
+        }
+
+    // The same noisy input scanned on three channels, each with a different filter,
+    // checking every so often how far each channel's value is from the true 512
+    adc_filter iir_filter, boxcar_filter, median_filter;
+    iir_filter.configure (FILTER_IIR, 4);
+    boxcar_filter.configure (FILTER_BOXCAR, 8);
+    median_filter.configure (FILTER_MEDIAN, 5);
+    my_adc.attach_filter (0, &iir_filter);
+    my_adc.attach_filter (1, &boxcar_filter);
+    my_adc.attach_filter (2, &median_filter);
+    sim_adc_set_source (noisy_source);
+    unsigned int worst[4] = { 0, 0, 0, 0 };
+    unsigned int scan_frame[4];
+    my_adc.start_scan (0x0F, scan_frame, true);
+    cpu_start = sim_cycles ();
+    while (sim_cycles () - cpu_start < sim_cpu_hz () / 2)
+        {
+        sim_advance (997);
+        if (sim_cycles () - cpu_start < sim_cpu_hz () / 100)
+            continue;                           // Give the filters time to settle
+        unsigned int now[4] = { my_adc.filtered (0), my_adc.filtered (1),
+                                my_adc.filtered (2), scan_frame[3] };
+        for (unsigned char index = 0; index < 4; index++)
+            {
+            unsigned int off = (now[index] > 512) ? now[index] - 512 : 512 - now[index];
+            if (off > worst[index])
+                worst[index] = off;
+            }
+        my_adc.next_frame ();
+        }
+    my_adc.stop ();
+    for (unsigned char channel = 0; channel < 3; channel++)
+        my_adc.attach_filter (channel, NULL);
+    sim_adc_set_source (NULL);
+    printf ("filters:            worst error raw %u, IIR 1/16 %u, boxcar 8 %u, "
+            "median 5 %u\n", worst[3], worst[0], worst[1], worst[2]);
+
+    // The slowly changing inputs scanned 100 times a second for 5 seconds again, with
+    // each channel checked against a window; only the crossings are printed, and a
+    // text_buffer with no ports counts what printing every scan would have taken
+    text_buffer as_events, every_scan;
+    adc_event event;
+    unsigned int event_count = 0;
+    for (unsigned char channel = 0; channel < 4; channel++)
+        my_adc.set_window (channel, 300, 724, 16);
+    sim_adc_set_source (slow_source);
+    my_adc.set_sample_rate (400);
+    my_adc.start_scan (0x0F, frame, true);
+    cpu_start = sim_cycles ();
+    while (sim_cycles () - cpu_start < 5 * sim_cpu_hz ())
+        {
+        if (!my_adc.frame_ready ())
+            {
+            sim_advance (1000);
+            continue;
+            }
+        every_scan << frame[0] << " " << frame[1] << " " << frame[2] << " "
+                   << frame[3] << endl;
+        my_adc.next_frame ();
+        if (!my_adc.get_event (event))
+            continue;
+        as_events << "Changed:";
+        do
+            {
+            as_events << " " << event;
+            event_count++;
+            }
+        while (my_adc.get_event (event));
+        as_events << endl;
+        }
+    my_adc.stop ();
+    my_adc.set_sample_rate (0);
+    sim_adc_set_source (NULL);
+    for (unsigned char channel = 0; channel < 4; channel++)
+        my_adc.clear_window (channel);
+    unsigned long event_total = as_events.get_passed_on () + as_events.get_length ();
+    unsigned long scan_total = every_scan.get_passed_on () + every_scan.get_length ();
+    printf ("window events:      %u events, %u lost, %lu bytes; %.1fx less than every "
+            "scan\n", event_count, my_adc.lost_events (), event_total,
+            (double)scan_total / event_total);
+
+    // Time stamps on samples streamed at 1000 Hz, where the timer starts conversions,
+    // then on readings taken by a loop which does an uneven amount of other work
+    // between them, as a main loop would
+    adc_intervals timed_stats, loop_stats;
+    unsigned int stamps[ADC_BUFFER_SIZE];
+    unsigned int worst_gap = 0, last_stamp = 0;
+    bool have_stamp = false;
+    my_adc.use_timestamps (true);
+    my_adc.set_sample_rate (1000);
+    my_adc.start_streaming (0);
+    start = sim_cycles ();
+    while (sim_cycles () - start < sim_cpu_hz () / 10)
+        {
+        sim_advance (5000);
+        unsigned char count = my_adc.read_samples (batch, stamps, ADC_BUFFER_SIZE);
+        for (unsigned char index = 0; index < count; index++)
+            {
+            unsigned int gap = (uint16_t)(stamps[index] - last_stamp);
+            if (have_stamp && gap > worst_gap)
+                worst_gap = gap;
+            last_stamp = stamps[index];
+            have_stamp = true;
+            }
+        }
+    my_adc.stop ();
+    my_adc.set_sample_rate (0);
+    my_adc.get_intervals (timed_stats);
+    my_adc.clear_intervals ();
+    unsigned long seed = 1;
+    for (unsigned int reading = 0; reading < 200; reading++)
+        {
+        my_adc.read_once (0);
+        seed = seed * 1103515245UL + 12345UL;
+        sim_advance (7000 + (seed >> 16) % 2000);
+        }
+    my_adc.get_intervals (loop_stats);
+    my_adc.use_timestamps (false);
+    double tick_us = ADC_STAMP_DIVIDER * 1.0e6 / (double)sim_cpu_hz ();
+    printf ("stamped 1000 Hz:    %8.1f us mean, %.1f to %.1f us, jitter %.1f us, "
+            "ring gap %.1f us\n",
+            tick_us * timed_stats.total / timed_stats.count,
+            tick_us * timed_stats.shortest, tick_us * timed_stats.longest,
+            tick_us * (timed_stats.longest - timed_stats.shortest),
+            tick_us * worst_gap);
+    printf ("stamped read_once:  %8.1f us mean, %.1f to %.1f us, jitter %.1f us\n",
+            tick_us * loop_stats.total / loop_stats.count,
+            tick_us * loop_stats.shortest, tick_us * loop_stats.longest,
+            tick_us * (loop_stats.longest - loop_stats.shortest));
+
+    // The scheduler running a 100 Hz task for one simulated second, sleeping between
+    task_scheduler scheduler;
+    scheduler.add_task (bench_task, &my_adc, 10);
+    start = sim_cycles ();
+    unsigned long long slept = sim_sleep_cycles ();
+    while (sim_cycles () - start < sim_cpu_hz ())
+        {
+        if (!scheduler.run_ready ())
+            scheduler.sleep_until_tick ();
+        }
+    elapsed = sim_cycles () - start;
+    slept = sim_sleep_cycles () - slept;
+    printf ("scheduler:          %8.1f us between runs, %lu runs, %u overruns, "
+            "%.1f%% asleep\n", usec (task_times[1] - task_times[0]) / (task_runs - 1),
+            task_runs, scheduler.get_task (0).overruns, 100.0 * slept / elapsed);
+
+    // How deep the benchmarks took the stack, on the PC, so only as a comparison
+    scheduler.watch_memory (&memory);
+    scheduler.run_ready ();
+    printf ("stack monitor:      %8u bytes used at most, %u never used, canary %s\n",
+            memory.stack_used (), memory.never_used (),
+            memory.check_canary () ? "OK" : "overwritten");
+
+    printf ("\n%lu conversions and %lu interrupts simulated\n",
+            sim_adc_conversions (), sim_interrupts ());
+
+    // The drivers' own performance counters, printed through the serial port, if
+    // they've been compiled in
+    #ifdef PERF_COUNTERS
+        adc_counters adc_stats;
+        serial_counters serial_stats;
+        my_adc.get_counters (adc_stats);
+        the_serial_port.get_counters (serial_stats);
+        sim_uart_clear (PORT);
+        the_serial_port << adc_stats << serial_stats;
+        the_serial_port.transmit_now ();
+        wait_for_serial ();
+        unsigned int count = sim_uart_captured (PORT, &p_data);
+        printf ("\n%.*s", (int)count, p_data);
+    #endif
+
+    return (0);
+    }
@@ -0,0 +1,689 @@
+//*************************************************************************************
+/** \file sim_test.cc
+ *        This program checks the drivers on a PC, against the simulated ATmega128 in
+ *        avr_sim.cc. Each driver has a function which gives it known inputs and
+ *        compares what comes out with what should; every wrong result is printed,
+ *        and the program returns nonzero if there were any. Unlike sim_bench, it's
+ *        built with the drivers' own retry limits, so the timeout paths are checked
+ *        too. Build it and run it with 'make test'.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+#include "rs232.h"
+#include "rs232_port.h"
+#include "avr_adc.h"
+#include "adc_filter.h"
+#include "binary_frame.h"
+#include "delta_frame.h"
+#include "task_scheduler.h"
+#include "text_buffer.h"
+#include "mem_monitor.h"
+#include "avr_sim.h"
+
+
+/// This is the baud rate setting used by adc_test, 9600 baud
+typedef uart_baud<F_CPU, 9600> test_baud;
+
+/// This is the serial port which is checked
+#define PORT                1
+
+/// This is how many checks have been made, and how many of them failed
+static unsigned int checks = 0;
+static unsigned int failures = 0;
+
+/// This checks that something is true, and prints where it was checked if it isn't
+#define CHECK(test) check ((test), #test, __LINE__)
+
+
+//-------------------------------------------------------------------------------------
+/** This function counts one check, and prints it if it failed.
+ *  @param passed True if the check passed
+ *  @param p_text The text of the check
+ *  @param line The line in this file where the check is
+ */
+
+static void check (bool passed, const char* p_text, int line)
+    {
+    checks++;
+    if (!passed)
+        {
+        failures++;
+        printf ("sim_test.cc:%d: failed: %s\n", line, p_text);
+        }
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks that a buffer holds the text it should.
+ *  @param p_data A pointer to the characters, which needn't end with a '\\0'
+ *  @param length The number of characters
+ *  @param p_expected The text which should be there
+ *  @return True if the text is the same
+ */
+
+static bool same_text (const char* p_data, unsigned int length, const char* p_expected)
+    {
+    return (length == strlen (p_expected) && memcmp (p_data, p_expected, length) == 0);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function lets simulated time pass until the serial port has sent everything
+ *  it's going to send.
+ *  @param port The serial port to wait for
+ */
+
+static void wait_for_serial (unsigned char port)
+    {
+    const char* p_data;
+    unsigned int count;
+
+    do
+        {
+        count = sim_uart_captured (port, &p_data);
+        sim_advance (20000);
+        }
+    while (sim_uart_captured (port, &p_data) != count);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** These are the A/D inputs. Each channel reads the level set for it here, so the
+ *  checks can move the inputs and know what every reading should be.
+ */
+
+static unsigned int levels[8];
+
+//-------------------------------------------------------------------------------------
+/** This function gives the simulated A/D converter its inputs.
+ *  @param channel The A/D channel being read
+ *  @param cycle The simulated cycle at which the conversion finishes
+ *  @return The level set for the channel
+ */
+
+static unsigned int level_source (unsigned char channel, unsigned long long cycle)
+    {
+    (void)cycle;
+    return (levels[channel & 0x07]);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks the numbers which the serial classes print, in each base,
+ *  through a text_buffer which keeps what it's given.
+ */
+
+static void check_num_format (void)
+    {
+    text_buffer text;
+
+    text << 1234U << " " << -56 << " " << 78901UL << " " << -2000000L << " " << 0U
+         << " " << 65535U << " " << 4294967295UL << " " << (char)-3 << " "
+         << (unsigned char)200 << " " << true << false << endl;
+    CHECK (same_text (text.get_text (), text.get_length (),
+                      "1234 -56 78901 -2000000 0 65535 4294967295 -3 200 TF\r\n"));
+
+    text.clear ();
+    text << hex << 0xBEEFU << " " << -56 << " " << (unsigned char)0x0A << " "
+         << 0x12345678UL << " " << 0U << " " << (char)-1 << dec;
+    CHECK (same_text (text.get_text (), text.get_length (),
+                      "beef ffc8 a 12345678 0 ff"));
+
+    text.clear ();
+    text << bin << (unsigned char)5 << " " << 0x8001U << oct << " " << 8U << " "
+         << 511U << " " << 0U << dec << " " << 10U;
+    CHECK (same_text (text.get_text (), text.get_length (),
+                      "00000101 1000000000000001 10 777 0 10"));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks the A/D converter: single readings, readings begun with
+ *  start(), one-shot scans, streaming, oversampling, windows, and a converter which
+ *  never finishes.
+ *  @param p_serial A pointer to the serial port the A/D object is given
+ */
+
+static void check_avr_adc (base_text_serial* p_serial)
+    {
+    avr_adc adc (p_serial);
+
+    for (unsigned char channel = 0; channel < 8; channel++)
+        levels[channel] = channel * 100 + 50;
+    sim_adc_set_source (level_source);
+
+    // Each channel reads its own input, and only the channel bits go in ADMUX
+    for (unsigned char channel = 0; channel < 8; channel++)
+        CHECK (adc.read_once (channel) == levels[channel]);
+    unsigned char refs = ADMUX & 0b11100000;
+    CHECK (adc.read_once (0xE5) == levels[5]);
+    CHECK ((ADMUX & 0b11100000) == refs);
+    CHECK (adc.read_millivolts (2) == 250UL * ADC_VREF_MV / 1024);
+
+    // A reading begun with start() is picked up later
+    CHECK (adc.start (3));
+    unsigned int polls = 0;
+    while (!adc.ready () && polls++ < 1000)
+        sim_advance (100);
+    CHECK (adc.result () == levels[3]);
+
+    // A one-shot scan fills the frame, and a reading right after it gets its channel
+    unsigned int frame[4];
+    CHECK (adc.start_scan (0x0F, frame, false));
+    polls = 0;
+    while (!adc.frame_ready () && polls++ < 1000)
+        sim_advance (100);
+    for (unsigned char channel = 0; channel < 4; channel++)
+        CHECK (frame[channel] == levels[channel]);
+    CHECK (adc.read_once (5) == levels[5]);
+    adc.next_frame ();
+
+    // While streaming, a single reading is refused and the stream goes on
+    unsigned int batch[ADC_BUFFER_SIZE];
+    adc.start_streaming (6);
+    sim_advance (20000);
+    CHECK (adc.busy ());
+    CHECK (!adc.start (1));
+    CHECK (adc.read_once (1) == 0xFFFF);
+    sim_advance (20000);
+    unsigned char count = adc.read_samples (batch, ADC_BUFFER_SIZE);
+    CHECK (count > 0);
+    for (unsigned char index = 0; index < count; index++)
+        CHECK (batch[index] == levels[6]);
+    adc.stop ();
+    CHECK (!adc.busy ());
+    CHECK (adc.timeouts () == 0);
+
+    // Sixteen conversions added up make a 12-bit sample four times the 10-bit one
+    CHECK (!adc.set_oversampling (ADC_MAX_OVERSAMPLE + 1));
+    CHECK (adc.set_oversampling (2));
+    CHECK (adc.resolution () == 12);
+    adc.start_streaming (2);
+    sim_advance (100000);
+    count = adc.read_samples (batch, ADC_BUFFER_SIZE);
+    adc.stop ();
+    CHECK (count > 0);
+    for (unsigned char index = 0; index < count; index++)
+        CHECK (batch[index] == levels[2] * 4);
+    adc.set_oversampling (0);
+    CHECK (adc.resolution () == 10);
+
+    // A window reports each crossing once, with hysteresis on the way back
+    static const unsigned int inputs[] = { 500, 800, 710, 700, 100, 310, 320 };
+    static const adc_zone zones[] = { ADC_ZONE_NORMAL, ADC_ZONE_HIGH, ADC_ZONE_HIGH,
+        ADC_ZONE_NORMAL, ADC_ZONE_LOW, ADC_ZONE_LOW, ADC_ZONE_NORMAL };
+    adc_event event;
+    CHECK (!adc.set_window (0, 724, 300, 16));
+    CHECK (adc.set_window (0, 300, 724, 16));
+    for (unsigned char index = 0; index < sizeof (inputs) / sizeof (inputs[0]); index++)
+        {
+        levels[0] = inputs[index];
+        adc.read_once (0);
+        CHECK (adc.zone (0) == zones[index]);
+        if (index > 0 && zones[index] == zones[index - 1])
+            CHECK (!adc.get_event (event));
+        else
+            {
+            CHECK (adc.get_event (event));
+            CHECK (event.channel == 0 && event.zone == zones[index]
+                   && event.value == inputs[index]);
+            }
+        }
+    CHECK (adc.lost_events () == 0);
+    adc.clear_window (0);
+
+    // A converter which never finishes is given up on after ADC_RETRIES polls
+    sim_adc_stall (true);
+    CHECK (adc.read_once (1) == 0xFFFF);
+    CHECK (adc.timeouts () == 1);
+    CHECK (adc.result () == 0xFFFF);
+    sim_adc_stall (false);
+    CHECK (adc.read_once (1) == levels[1]);
+    CHECK (adc.timeouts () == 1);
+
+    sim_adc_set_source (NULL);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks the filters with samples given to them directly.
+ */
+
+static void check_adc_filter (void)
+    {
+    adc_filter filter;
+
+    CHECK (!filter.configure (FILTER_IIR, 0));
+    CHECK (!filter.configure (FILTER_IIR, ADC_IIR_MAX_SHIFT + 1));
+    CHECK (!filter.configure (FILTER_BOXCAR, 3));
+    CHECK (!filter.configure (FILTER_MEDIAN, ADC_FILTER_LENGTH + 1));
+
+    // The first sample fills the filter; each one after moves it a quarter of the way
+    CHECK (filter.configure (FILTER_IIR, 2));
+    CHECK (filter.value () == 0);
+    filter.update (100);
+    CHECK (filter.value () == 100);
+    filter.update (200);
+    CHECK (filter.value () == 125);
+    filter.update (200);
+    CHECK (filter.value () == 144);
+
+    // The boxcar takes the average of the last four
+    CHECK (filter.configure (FILTER_BOXCAR, 4));
+    filter.update (100);
+    filter.update (200);
+    CHECK (filter.value () == 125);
+    filter.update (200);
+    filter.update (200);
+    filter.update (200);
+    CHECK (filter.value () == 200);
+
+    // The median of three ignores one spike, but not two in a row
+    CHECK (filter.configure (FILTER_MEDIAN, 3));
+    filter.update (100);
+    filter.update (1000);
+    CHECK (filter.value () == 100);
+    filter.update (1000);
+    CHECK (filter.value () == 1000);
+
+    filter.reset ();
+    CHECK (filter.value () == 0);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks the serial port: text sent with and without the buffer, each
+ *  full buffer policy, receiving with and without the buffer, overruns, and a
+ *  transmitter too slow to keep up.
+ */
+
+static void check_rs232 (void)
+    {
+    const char* p_data;
+    unsigned int count;
+    char letter;
+
+    // Sent one character at a time, waiting for the transmitter each time
+    rs232 serial (test_baud (), PORT);
+    sei ();
+    sim_uart_clear (PORT);
+    serial << "Hello, " << 42U << endl;
+    wait_for_serial (PORT);
+    count = sim_uart_captured (PORT, &p_data);
+    CHECK (same_text (p_data, count, "Hello, 42\r\n"));
+
+    // Sent through the buffer by the interrupt routine
+    static const char* p_long = "0123456789abcdefghijklmnopqrstuvwxyz"
+                                "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    serial.use_tx_buffer (TX_BLOCK);
+    sim_uart_clear (PORT);
+    serial << "Buffered" << endl;
+    wait_for_serial (PORT);
+    count = sim_uart_captured (PORT, &p_data);
+    CHECK (same_text (p_data, count, "Buffered\r\n"));
+
+    // With interrupts off the buffer can't empty; the policy says what's kept
+    serial.use_tx_buffer (TX_DROP);
+    sim_uart_clear (PORT);
+    cli ();
+    CHECK (!serial.write (p_long, strlen (p_long)));
+    sei ();
+    wait_for_serial (PORT);
+    count = sim_uart_captured (PORT, &p_data);
+    CHECK (count == UART_TX_BUF_SIZE - 1);
+    CHECK (memcmp (p_data, p_long, count) == 0);
+
+    serial.use_tx_buffer (TX_OVERWRITE);
+    sim_uart_clear (PORT);
+    cli ();
+    serial.write (p_long, strlen (p_long));
+    sei ();
+    wait_for_serial (PORT);
+    count = sim_uart_captured (PORT, &p_data);
+    CHECK (count == UART_TX_BUF_SIZE - 1);
+    CHECK (memcmp (p_data, p_long + strlen (p_long) - count, count) == 0);
+
+    // Blocking for room gives up after UART_TX_TOUT tries, and so does transmit_now()
+    serial.use_tx_buffer (TX_BLOCK);
+    sim_uart_clear (PORT);
+    cli ();
+    CHECK (!serial.write (p_long, strlen (p_long)));
+    serial.transmit_now ();
+    sei ();
+    wait_for_serial (PORT);
+    count = sim_uart_captured (PORT, &p_data);
+    CHECK (count == UART_TX_BUF_SIZE - 1);
+    #ifdef PERF_COUNTERS
+        serial_counters stats;
+        serial.get_counters (stats);
+        CHECK (stats.tx_timeouts == strlen (p_long) - count);
+    #endif
+
+    // Received without the buffer, a character not read in time is counted as lost
+    rs232 receiver (test_baud (), PORT);
+    sim_uart_inject (PORT, "ab", 2);
+    sim_advance (30000);
+    CHECK (receiver.getchar (letter, 1000) && letter == 'a');
+    CHECK (!receiver.getchar (letter, 1000));
+    CHECK (receiver.rx_overruns () == 1);
+
+    // Received into the buffer by the interrupt routine, nothing is lost
+    receiver.use_rx_buffer ();
+    sim_uart_inject (PORT, "xyz", 3);
+    sim_advance (50000);
+    CHECK (receiver.check_for_char ());
+    CHECK (receiver.getchar () == 'x');
+    CHECK (receiver.getchar () == 'y');
+    CHECK (receiver.getchar () == 'z');
+    CHECK (!receiver.check_for_char ());
+    CHECK (receiver.rx_overruns () == 1);
+
+    // The slowest divisor takes over 650000 cycles a character; the third character
+    // has to wait for the first, which is longer than UART_TX_TOUT polls
+    rs232 slow (uart_setting (UART_MAX_DIVISOR, false), PORT);
+    sim_uart_clear (PORT);
+    CHECK (slow.putchar ('1'));
+    CHECK (slow.putchar ('2'));
+    CHECK (!slow.putchar ('3'));
+    #ifdef PERF_COUNTERS
+        slow.get_counters (stats);
+        CHECK (stats.tx_timeouts == 1);
+    #endif
+    sim_advance (2 * 10 * 16 * (UART_MAX_DIVISOR + 1));
+    count = sim_uart_captured (PORT, &p_data);
+    CHECK (same_text (p_data, count, "12"));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks that the template port class sends the same text as the
+ *  rs232 class.
+ */
+
+static void check_rs232_port (void)
+    {
+    const char* p_data;
+    test_baud setting;
+    rs232_port<PORT> port (setting);
+
+    sim_uart_clear (PORT);
+    port << "N " << 1234U << " " << -56 << " " << 78901UL << " " << hex << 0xBEEFU
+         << dec << " " << true << endl;
+    wait_for_serial (PORT);
+    unsigned int count = sim_uart_captured (PORT, &p_data);
+    CHECK (same_text (p_data, count, "N 1234 -56 78901 beef T\r\n"));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function undoes the COBS encoding of a frame and checks its checksum.
+ *  @param p_data A pointer to the encoded frame, which ends with a zero
+ *  @param length The number of bytes in the encoded frame
+ *  @param p_frame A pointer to where the frame is put, without the checksum
+ *  @return The number of bytes in the frame, or zero if it's broken
+ */
+
+static unsigned int decode_frame (const unsigned char* p_data, unsigned int length,
+                                  unsigned char* p_frame)
+    {
+    unsigned int size = 0, index = 0;
+
+    if (length < 2 || p_data[length - 1] != 0)
+        return (0);
+
+    while (index < length - 1)
+        {
+        unsigned char code = p_data[index++];
+
+        if (code == 0 || index + code - 1 > length - 1)
+            return (0);
+        for (unsigned char count = 1; count < code; count++)
+            p_frame[size++] = p_data[index++];
+        if (index < length - 1)
+            p_frame[size++] = 0;
+        }
+
+    if (size < 2)
+        return (0);
+
+    unsigned int crc = 0xFFFF;
+    for (index = 0; index < size - 2; index++)
+        crc = _crc_ccitt_update (crc, p_frame[index]);
+    if (p_frame[size - 2] != (unsigned char)(crc >> 8)
+        || p_frame[size - 1] != (unsigned char)crc)
+        return (0);
+
+    return (size - 2);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks the binary frames of samples and blocks, and the compressed
+ *  frames of scans, by taking them apart again.
+ */
+
+static void check_frames (void)
+    {
+    text_buffer sent;
+    unsigned char frame[FRAME_MAX_PAYLOAD + 2];
+    unsigned int size;
+
+    // Four 10-bit samples packed into five bytes, least significant bit first
+    static const unsigned int samples[4] = { 50, 150, 250, 350 };
+    static const unsigned char packed[] = { 0xA5, 0x00, 0x0F, 0x32, 0x58, 0xA2, 0x8F,
+                                            0x57 };
+    binary_frame_writer writer (&sent);
+    writer.send_samples (0x0F, samples);
+    size = decode_frame ((const unsigned char*)sent.get_text (), sent.get_length (),
+                         frame);
+    CHECK (size == sizeof (packed) && memcmp (frame, packed, size) == 0);
+
+    // Each frame has the next sequence number
+    static const unsigned int block[3] = { 0x1FFF, 0x0000, 0x1234 };
+    static const unsigned char block_packed[] = { 0xA6, 0x01, 0x02, 0x0D, 0x03, 0xFF,
+                                                  0x1F, 0x00, 0xD0, 0x48 };
+    sent.clear ();
+    CHECK (writer.send_block (2, 13, block, 3));
+    size = decode_frame ((const unsigned char*)sent.get_text (), sent.get_length (),
+                         frame);
+    CHECK (size == sizeof (block_packed) && memcmp (frame, block_packed, size) == 0);
+    CHECK (!writer.send_block (2, 17, block, 3));
+    CHECK (!writer.send_block (2, 16, block, FRAME_MAX_PAYLOAD / 2));
+
+    // A key frame starts from zero, then the differences are zigzagged varints
+    static const unsigned int first[2] = { 100, 200 };
+    static const unsigned int second[2] = { 101, 198 };
+    static const unsigned char key_packed[] = { FRAME_DELTA, 0x00, 0x03, DELTA_KEY_FLAG,
+                                                0xC8, 0x01, 0x90, 0x03, 0x02, 0x03 };
+    static const unsigned char next_packed[] = { FRAME_DELTA, 0x01, 0x03, 0x00, 0x01,
+                                                 0x04 };
+    delta_frame_writer delta (&sent, 0x03);
+    sent.clear ();
+    delta.add_scan (first);
+    delta.add_scan (second);
+    delta.flush ();
+    size = decode_frame ((const unsigned char*)sent.get_text (), sent.get_length (),
+                         frame);
+    CHECK (size == sizeof (key_packed) && memcmp (frame, key_packed, size) == 0);
+
+    sent.clear ();
+    delta.add_scan (first);
+    delta.flush ();
+    size = decode_frame ((const unsigned char*)sent.get_text (), sent.get_length (),
+                         frame);
+    CHECK (size == sizeof (next_packed) && memcmp (frame, next_packed, size) == 0);
+
+    sent.clear ();
+    delta.flush ();
+    CHECK (sent.get_length () == 0);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks that a text buffer keeps text until it's full or told to
+ *  send it, and then passes it on to each of its outputs.
+ */
+
+static void check_text_buffer (void)
+    {
+    text_buffer first, second;
+    text_buffer buffer (8);
+
+    CHECK (buffer.add_output (&first));
+    CHECK (buffer.add_output (&second));
+    CHECK (!buffer.add_output (NULL));
+
+    buffer << "abc";
+    CHECK (buffer.get_length () == 3 && first.get_length () == 0);
+    buffer << "defghij";
+    CHECK (same_text (first.get_text (), first.get_length (), "abcdefgh"));
+    CHECK (same_text (buffer.get_text (), buffer.get_length (), "ij"));
+    buffer << send_now;
+    CHECK (same_text (second.get_text (), second.get_length (), "abcdefghij"));
+    CHECK (buffer.get_length () == 0 && buffer.get_passed_on () == 10);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This task is run by the scheduler check. It counts its runs.
+ *  @param p_data A pointer to the count
+ */
+
+static void count_task (void* p_data)
+    {
+    (*(unsigned long*)p_data)++;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks that the scheduler runs tasks at their rates.
+ */
+
+static void check_task_scheduler (void)
+    {
+    task_scheduler scheduler;
+    unsigned long fast_runs = 0, slow_runs = 0;
+
+    CHECK (!scheduler.add_task (count_task, &fast_runs, 0));
+    CHECK (scheduler.add_task (count_task, &fast_runs, 10));
+    CHECK (scheduler.add_task (count_task, &slow_runs, 250));
+    CHECK (scheduler.get_task_count () == 2);
+
+    // One simulated second, sleeping between ticks
+    unsigned long long start = sim_cycles ();
+    while (sim_cycles () - start < sim_cpu_hz ())
+        {
+        if (!scheduler.run_ready ())
+            scheduler.sleep_until_tick ();
+        }
+    CHECK (fast_runs >= 99 && fast_runs <= 100);
+    CHECK (slow_runs == 4);
+    CHECK (scheduler.get_task (0).runs == fast_runs);
+    CHECK (scheduler.get_task (0).overruns == 0);
+    CHECK (scheduler.get_ticks () >= SCHED_TICK_HZ - 1);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This class lets the memory check scratch the canary, as the stack would.
+ */
+
+class test_monitor : public mem_monitor
+    {
+    public:
+        /// This method changes the lowest byte of the canary
+        void scratch_canary (void)
+            {
+            *p_bottom = (unsigned char)~MEM_PAINT;
+            }
+    };
+
+
+//-------------------------------------------------------------------------------------
+/** This function is called by the memory monitor when the canary is scratched.
+ *  @param p_data A pointer to the number of calls
+ */
+
+static void count_alarm (void* p_data)
+    {
+    (*(unsigned int*)p_data)++;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function uses some stack, so the memory monitor has something to find.
+ *  @return A number worked out from the stack, so it isn't optimized away
+ */
+
+static unsigned int use_stack (void) __attribute__ ((noinline));
+
+static unsigned int use_stack (void)
+    {
+    volatile unsigned char scratch[2000];
+
+    for (unsigned int index = 0; index < sizeof (scratch); index++)
+        scratch[index] = (unsigned char)index;
+
+    return (scratch[sizeof (scratch) - 1]);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks that the memory monitor sees how deep the stack has gone and
+ *  calls its callback once when the canary is scratched.
+ *  @param memory The memory monitor, which main() made first
+ */
+
+static void check_mem_monitor (test_monitor& memory)
+    {
+    unsigned int alarms = 0;
+
+    use_stack ();
+    CHECK (memory.stack_used () >= 2000);
+    CHECK (memory.stack_used () <= memory.stack_size ());
+    CHECK (memory.never_used () == memory.stack_size () - memory.stack_used ());
+    CHECK (memory.free_ram () > 0);
+
+    memory.set_callback (count_alarm, &alarms);
+    CHECK (memory.canary_ok () && memory.check_canary ());
+    memory.scratch_canary ();
+    CHECK (!memory.canary_ok ());
+    CHECK (!memory.check_canary ());
+    CHECK (!memory.check_canary ());
+    CHECK (alarms == 1);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** The main function runs the check for each driver and prints how many failed.
+ *  @return Zero if every check passed, one if any failed
+ */
+
+int main (void)
+    {
+    test_monitor memory;
+    rs232 the_serial_port (test_baud (), PORT);
+    sei ();
+
+    check_num_format ();
+    check_avr_adc (&the_serial_port);
+    check_adc_filter ();
+    check_rs232 ();
+    check_rs232_port ();
+    check_frames ();
+    check_text_buffer ();
+    check_task_scheduler ();
+    check_mem_monitor (memory);
+
+    printf ("%u checks, %u failed\n", checks, failures);
+
+    return (failures == 0 ? 0 : 1);
+    }
@@ -0,0 +1,34 @@
+//*************************************************************************************
+/** \file host/util/crc16.h
+ *        This file stands in for avr-libc's <util/crc16.h> when the drivers are built
+ *        to run on a PC. The function gives the same results as the avr-libc one.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#ifndef _SIM_UTIL_CRC16_H_
+#define _SIM_UTIL_CRC16_H_
+
+#include <stdint.h>
+
+
+//-------------------------------------------------------------------------------------
+/** This function updates a CRC-CCITT checksum with one more byte of data, in the same
+ *  way as avr-libc's optimized assembly version.
+ *  @param crc The checksum so far
+ *  @param data The byte to be added
+ *  @return The new checksum
+ */
+
+static inline uint16_t _crc_ccitt_update (uint16_t crc, uint8_t data)
+    {
+    data ^= (uint8_t)crc;
+    data ^= (uint8_t)(data << 4);
+
+    return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4)
+            ^ ((uint16_t)data << 3));
+    }
+
+#endif // _SIM_UTIL_CRC16_H_
@@ -0,0 +1,209 @@
+//*************************************************************************************
+/** \file mem_monitor.cc
+ *        This file contains a monitor which finds how deep the stack has gone and how
+ *        much RAM is free by looking at RAM painted at startup. See mem_monitor.h.
+ *
+ *        On a PC there's no SRAM to paint and no startup code to do it, so the
+ *        constructor paints MEM_HOST_STACK bytes of the PC's stack below its own
+ *        frame, and only the stack used after the monitor is made is counted. The
+ *        simulator runs the interrupt routines on a stack of their own, so there
+ *        they aren't counted either.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#include <stdlib.h>
+#include <avr/io.h>
+#include "mem_monitor.h"
+
+
+/** This many bytes just below the constructor's frame on a PC are left unpainted, for
+ *  the constructor's own work and the area below the stack pointer which the PC's
+ *  compiler may use without moving it
+ */
+#define MEM_HOST_MARGIN     256
+
+
+#ifdef __AVR__
+    /// This is put by the linker just past the last variable, where a heap would start
+    extern unsigned char __heap_start;
+
+    void mem_paint (void) __attribute__ ((naked, used, section (".init3")));
+
+    //---------------------------------------------------------------------------------
+    /** This function paints the RAM from the end of the variables up to the stack
+     *  pointer. It's put in the .init3 section, so the startup code runs it straight
+     *  through after setting up the stack pointer and before the variables are filled
+     *  in or any constructor runs. It's naked, as there's nothing to return to.
+     */
+
+    void mem_paint (void)
+        {
+        unsigned char* p_byte = &__heap_start;
+
+        while (p_byte <= (unsigned char*)SP)
+            *p_byte++ = MEM_PAINT;
+        }
+#endif
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor finds the painted RAM. On the AVR it runs from the end of the
+ *  variables to the end of the SRAM; on a PC, it's painted here.
+ */
+
+mem_monitor::mem_monitor (void)
+    {
+    #ifdef __AVR__
+        p_bottom = &__heap_start;
+        p_top = (unsigned char*)RAMEND + 1;
+    #else
+        p_top = (unsigned char*)__builtin_frame_address (0) - MEM_HOST_MARGIN;
+        p_bottom = p_top - MEM_HOST_STACK;
+        for (volatile unsigned char* p_byte = p_bottom; p_byte < p_top; p_byte++)
+            *p_byte = MEM_PAINT;
+    #endif
+
+    canary_broken = false;
+    callback = NULL;
+    p_callback_data = NULL;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns how much RAM the stack can use before it reaches the canary.
+ *  @return The size of the painted RAM above the canary, in bytes
+ */
+
+unsigned int mem_monitor::stack_size (void)
+    {
+    return ((unsigned int)(p_top - p_bottom) - MEM_CANARY_SIZE);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method finds the deepest the stack has ever been, by looking up from the
+ *  canary for the first byte which isn't the paint any more. A byte which the stack
+ *  happened to fill with the paint value looks unused, so the answer can be a few
+ *  bytes short, but it's never too big.
+ *  @return The most bytes of stack which have been used since startup
+ */
+
+unsigned int mem_monitor::stack_used (void)
+    {
+    volatile unsigned char* p_byte = p_bottom + MEM_CANARY_SIZE;
+
+    while (p_byte < p_top && *p_byte == MEM_PAINT)
+        p_byte++;
+
+    return ((unsigned int)(p_top - p_byte));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns how much of the stack has never been used. This is the real
+ *  margin: the RAM which a new buffer could take without the stack running into it.
+ *  @return The number of bytes the stack has never reached
+ */
+
+unsigned int mem_monitor::never_used (void)
+    {
+    return (stack_size () - stack_used ());
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns how much RAM is between the canary and the stack pointer now.
+ *  @return The number of bytes free at the moment
+ */
+
+unsigned int mem_monitor::free_ram (void)
+    {
+    #ifdef __AVR__
+        unsigned char* p_stack = (unsigned char*)SP;
+    #else
+        unsigned char* p_stack = (unsigned char*)__builtin_frame_address (0);
+    #endif
+
+    if (p_stack <= p_bottom + MEM_CANARY_SIZE)
+        return (0);
+
+    return ((unsigned int)(p_stack - p_bottom) - MEM_CANARY_SIZE);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method checks whether the canary is still painted.
+ *  @return True if the stack hasn't reached the canary, false if it has
+ */
+
+bool mem_monitor::canary_ok (void)
+    {
+    volatile unsigned char* p_byte = p_bottom;
+
+    for (unsigned char count = 0; count < MEM_CANARY_SIZE; count++)
+        if (*p_byte++ != MEM_PAINT)
+            return (false);
+
+    return (true);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method checks the canary, and the first time it finds it overwritten, calls
+ *  the function given to set_callback(). It's cheap enough to call often, and the
+ *  task scheduler calls it each time it checks the tasks.
+ *  @return True if the canary has never been found overwritten
+ */
+
+bool mem_monitor::check_canary (void)
+    {
+    if (!canary_broken && !canary_ok ())
+        {
+        canary_broken = true;
+        if (callback != NULL)
+            callback (p_callback_data);
+        }
+
+    return (!canary_broken);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets a function to be called when check_canary() first finds that the
+ *  stack has run into the variables. The variables may be corrupted by then, so the
+ *  function should do little more than print a warning or stop the outputs.
+ *  @param function The function to be called, or NULL for none
+ *  @param p_data A pointer which is given to the function
+ */
+
+void mem_monitor::set_callback (mem_callback function, void* p_data)
+    {
+    callback = function;
+    p_callback_data = p_data;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This operator prints the deepest the stack has been, how much of it has never been
+ *  used, how much RAM is free now, and whether the canary is still there, for example
+ *  "Stack: 318 of 3830 bytes used, 3512 never used, 3724 free now, canary OK".
+ *  @param serial A reference to the serial-type object to which to print
+ *  @param monitor A reference to the memory monitor
+ */
+
+base_text_serial& operator<< (base_text_serial& serial, mem_monitor& monitor)
+    {
+    serial << FLASH_STR ("Stack: ") << monitor.stack_used () << FLASH_STR (" of ")
+           << monitor.stack_size () << FLASH_STR (" bytes used, ")
+           << monitor.never_used () << FLASH_STR (" never used, ")
+           << monitor.free_ram () << FLASH_STR (" free now, canary ");
+    if (monitor.check_canary ())
+        serial << FLASH_STR ("OK");
+    else
+        serial << FLASH_STR ("overwritten");
+
+    return (serial);
+    }
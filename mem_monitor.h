@@ -0,0 +1,102 @@
+//*************************************************************************************
+/** \file mem_monitor.h
+ *        This file contains a monitor which watches how much of the SRAM the stack
+ *        uses. When the processor starts, before the constructors run, the free RAM
+ *        between the end of the variables and the stack is painted with a pattern.
+ *        Wherever the stack has been, the pattern is gone, so looking for the lowest
+ *        byte which isn't the pattern any more shows the deepest the stack has ever
+ *        been, counting the interrupt routines and every buffer on the stack. The
+ *        first few bytes above the variables are a canary: if they've changed, the
+ *        stack has run into the variables and may have corrupted them.
+ *
+ *        The ATmega128 has 4 KB of SRAM, and the ring buffers, frame buffers and
+ *        number conversion buffers all come out of it, so knowing the real margin
+ *        lets new buffers be sized without guessing. The monitor can print what it
+ *        found through any base_text_serial device, and the task scheduler can be
+ *        given it to check the canary each time it checks the tasks.
+ *
+ *        This project doesn't use malloc(), so there's no heap between the variables
+ *        and the stack; if a heap is added, its top is where the free RAM starts.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _MEM_MONITOR_H_
+#define _MEM_MONITOR_H_
+
+#include "base_text_serial.h"               // For printing the report
+
+
+/// This is the byte with which unused RAM is painted
+#define MEM_PAINT           0xC5
+
+/// This is how many bytes just above the variables make up the canary
+#define MEM_CANARY_SIZE     8
+
+/** This is how much of the PC's stack is painted when the drivers are built to run on
+ *  a PC, where there's no SRAM to paint; it's painted below where the monitor is made
+ */
+#define MEM_HOST_STACK      32768
+
+/** This type of function is called by check_canary() the first time it finds that the
+ *  canary has been overwritten. It's given the pointer given to set_callback().
+ */
+typedef void (*mem_callback) (void*);
+
+
+//-------------------------------------------------------------------------------------
+/** This class looks at the painted RAM to find how much stack has been used and how
+ *  much RAM is free. Only one should be made, early in main():
+ *  \code
+ *    mem_monitor memory;
+ *    scheduler.watch_memory (&memory);
+ *    ...
+ *    serial << memory;
+ *  \endcode
+ */
+
+class mem_monitor
+    {
+    protected:
+        /// This is the lowest painted byte, the first byte of the canary
+        unsigned char* p_bottom;
+
+        /// This is just past the highest byte the stack can use
+        unsigned char* p_top;
+
+        /// This is true once check_canary() has found the canary overwritten
+        bool canary_broken;
+
+        /// This function is called when the canary is first found overwritten
+        mem_callback callback;
+
+        /// This pointer is given to the callback function
+        void* p_callback_data;
+
+    public:
+        // The constructor finds the painted RAM; on a PC, it paints some stack
+        mem_monitor (void);
+
+        // These methods tell how much stack has been used and how much RAM is free
+        unsigned int stack_size (void);
+        unsigned int stack_used (void);
+        unsigned int never_used (void);
+        unsigned int free_ram (void);
+
+        // These methods check whether the stack has run into the variables
+        bool canary_ok (void);
+        bool check_canary (void);
+        void set_callback (mem_callback, void*);
+    };
+
+
+//--------------------------------------------------------------------------------------
+/// This operator prints how much stack has been used, how much RAM is free, and
+/// whether the canary is still there
+
+base_text_serial& operator<< (base_text_serial&, mem_monitor&);
+
+#endif  // _MEM_MONITOR_H_
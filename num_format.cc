@@ -0,0 +1,312 @@
+//*************************************************************************************
+/** \file num_format.cc
+ *        This file contains functions which convert numbers to text in binary, octal,
+ *        decimal, or hexadecimal without doing any division.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ *      \li 10-16-26       Added signed numbers, shared by all the serial classes
+ */
+//*************************************************************************************
+
+#include "num_format.h"
+
+
+/// These are the powers of ten used to find the digits of a 32-bit decimal number
+static const unsigned long pow10_long[] =
+    { 1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL, 10000UL };
+
+/// These are the powers of ten used to find the digits of a 16-bit decimal number
+static const unsigned int pow10_int[] = { 10000, 1000, 100, 10 };
+
+/// These are the digits used for hexadecimal numbers, in lower case as utoa() has it
+static const char hex_digits[] = "0123456789abcdef";
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes the decimal digits of a 16-bit number. Each digit is found by
+ *  counting how many times its power of ten can be subtracted.
+ *  @param num The number to be written
+ *  @param p_out A pointer to where the first digit goes
+ *  @param started True if digits have already been written, so zeros at the front of
+ *      this number must be written too
+ *  @param first The index in pow10_int[] of the first power of ten to try
+ *  @return A pointer to the place just after the last digit
+ */
+
+static char* decimal_int (unsigned int num, char* p_out, bool started,
+                          unsigned char first)
+    {
+    for (unsigned char index = first; index < 4; index++)
+        {
+        unsigned int power = pow10_int[index];
+        char digit = '0';
+
+        while (num >= power)
+            {
+            num -= power;
+            digit++;
+            }
+
+        if (started || digit != '0')
+            {
+            *p_out++ = digit;
+            started = true;
+            }
+        }
+
+    *p_out++ = '0' + (char)num;             // The ones digit is always written
+    return (p_out);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes the hexadecimal digits of a number whose bytes are given most
+ *  significant first. Each byte makes two digits, so there's no shifting of the whole
+ *  number. Zeros at the front are left out, but there's always at least one digit.
+ *  @param p_bytes A pointer to the bytes of the number, most significant first
+ *  @param count The number of bytes
+ *  @param p_out A pointer to where the first digit goes
+ *  @return A pointer to the place just after the last digit
+ */
+
+static char* hex_bytes (const unsigned char* p_bytes, unsigned char count, char* p_out)
+    {
+    char* p_start = p_out;
+
+    while (count--)
+        {
+        unsigned char byte = *p_bytes++;
+        unsigned char high = byte >> 4;
+
+        if (high != 0 || p_out != p_start)
+            *p_out++ = hex_digits[high];
+        if (byte != 0 || p_out != p_start)
+            *p_out++ = hex_digits[byte & 0x0F];
+        }
+
+    if (p_out == p_start)
+        *p_out++ = '0';
+
+    return (p_out);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes the binary digits of a number whose bytes are given most
+ *  significant first. All the digits are written, including zeros at the front.
+ *  @param p_bytes A pointer to the bytes of the number, most significant first
+ *  @param count The number of bytes
+ *  @param p_out A pointer to where the first digit goes
+ *  @return A pointer to the place just after the last digit
+ */
+
+static char* binary_bytes (const unsigned char* p_bytes, unsigned char count,
+                           char* p_out)
+    {
+    while (count--)
+        {
+        unsigned char byte = *p_bytes++;
+
+        for (unsigned char bmask = 0x80; bmask != 0; bmask >>= 1)
+            *p_out++ = (byte & bmask) ? '1' : '0';
+        }
+
+    return (p_out);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function converts a 16-bit unsigned number to text in the given base. Binary
+ *  numbers are written with all their digits, zeros in front included, as the serial
+ *  classes have always done; other bases leave out zeros in front.
+ *  @param num The number to be converted
+ *  @param base The base, which must be 2, 8, 10, or 16
+ *  @param bits The number of binary digits to write, 8 or 16; it's only used when
+ *      the base is 2
+ *  @param p_out A pointer to a buffer with room for at least bits + 1 characters; a
+ *      '\\0' is put at the end of the text
+ *  @return The number of characters written, not counting the '\\0'
+ */
+
+unsigned char format_int (unsigned int num, unsigned char base, unsigned char bits,
+                          char* p_out)
+    {
+    char* p_start = p_out;
+    unsigned char bytes[2];
+
+    bytes[0] = (unsigned char)(num >> 8);
+    bytes[1] = (unsigned char)num;
+
+    switch (base)
+        {
+        case (2):
+            if (bits <= 8)
+                p_out = binary_bytes (bytes + 1, 1, p_out);
+            else
+                p_out = binary_bytes (bytes, 2, p_out);
+            break;
+        case (8):
+            {
+            // The top digit has only one bit; the rest have three each. Shifting the
+            // number left by a constant amount each time is quick on an AVR
+            bool started = false;
+            char digit = (char)(num >> 15);
+
+            for (unsigned char count = 0; count < 6; count++)
+                {
+                if (started || digit != 0 || count == 5)
+                    {
+                    *p_out++ = '0' + digit;
+                    started = true;
+                    }
+                num <<= (count == 0) ? 1 : 3;
+                digit = (char)((num >> 13) & 0x07);
+                }
+            }
+            break;
+        case (16):
+            p_out = hex_bytes (bytes, 2, p_out);
+            break;
+        default:
+            p_out = decimal_int (num, p_out, false, 0);
+            break;
+        }
+
+    *p_out = '\0';
+    return ((unsigned char)(p_out - p_start));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function converts a 32-bit unsigned number to text in the given base. Binary
+ *  numbers are written with all 32 digits; other bases leave out zeros in front.
+ *  Decimal numbers which fit in 16 bits are handed to the quicker 16-bit code, and
+ *  bigger ones switch to it as soon as what's left fits.
+ *  @param num The number to be converted
+ *  @param base The base, which must be 2, 8, 10, or 16
+ *  @param p_out A pointer to a buffer with room for at least 33 characters; a '\\0' is
+ *      put at the end of the text
+ *  @return The number of characters written, not counting the '\\0'
+ */
+
+unsigned char format_long (unsigned long num, unsigned char base, char* p_out)
+    {
+    char* p_start = p_out;
+    unsigned char bytes[4];
+
+    bytes[0] = (unsigned char)(num >> 24);
+    bytes[1] = (unsigned char)(num >> 16);
+    bytes[2] = (unsigned char)(num >> 8);
+    bytes[3] = (unsigned char)num;
+
+    switch (base)
+        {
+        case (2):
+            p_out = binary_bytes (bytes, 4, p_out);
+            break;
+        case (8):
+            {
+            // The top digit has two bits and the other ten have three each
+            bool started = false;
+            char digit = (char)(num >> 30);
+
+            for (unsigned char count = 0; count < 11; count++)
+                {
+                if (started || digit != 0 || count == 10)
+                    {
+                    *p_out++ = '0' + digit;
+                    started = true;
+                    }
+                num <<= (count == 0) ? 2 : 3;
+                digit = (char)((num >> 29) & 0x07);
+                }
+            }
+            break;
+        case (16):
+            p_out = hex_bytes (bytes, 4, p_out);
+            break;
+        default:
+            if (num <= 0xFFFF)
+                p_out = decimal_int ((unsigned int)num, p_out, false, 0);
+            else
+                {
+                bool started = false;
+
+                for (unsigned char index = 0; index < 6; index++)
+                    {
+                    unsigned long power = pow10_long[index];
+                    char digit = '0';
+
+                    while (num >= power)
+                        {
+                        num -= power;
+                        digit++;
+                        }
+
+                    if (started || digit != '0')
+                        {
+                        *p_out++ = digit;
+                        started = true;
+                        }
+                    }
+
+                // What's left is less than 10000, so the 16-bit code can finish
+                p_out = decimal_int ((unsigned int)num, p_out, true, 1);
+                }
+            break;
+        }
+
+    *p_out = '\0';
+    return ((unsigned char)(p_out - p_start));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function converts an 8 or 16-bit signed number to text in the given base. In
+ *  decimal, negative numbers get a minus sign; in other bases the 8 or 16 bits are
+ *  shown as they are, as if the number were unsigned.
+ *  @param num The number to be converted; an 8-bit one must be given as signed char
+ *  @param base The base, which must be 2, 8, 10, or 16
+ *  @param bits The size of the number, 8 or 16 bits
+ *  @param p_out A pointer to a buffer with room for at least bits + 2 characters; a
+ *      '\0' is put at the end of the text
+ *  @return The number of characters written, not counting the '\0'
+ */
+
+unsigned char format_signed (int num, unsigned char base, unsigned char bits,
+                             char* p_out)
+    {
+    if (base == 10 && num < 0)
+        {
+        *p_out = '-';
+        return (1 + format_int (0U - (unsigned int)num, base, bits, p_out + 1));
+        }
+
+    if (bits <= 8)
+        return (format_int ((unsigned char)num, base, bits, p_out));
+    return (format_int ((unsigned int)num, base, bits, p_out));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This function converts a 32-bit signed number to text in the given base. In
+ *  decimal, negative numbers get a minus sign; in other bases the 32 bits are shown
+ *  as they are, as if the number were unsigned.
+ *  @param num The number to be converted
+ *  @param base The base, which must be 2, 8, 10, or 16
+ *  @param p_out A pointer to a buffer with room for at least NUM_FORMAT_SIZE
+ *      characters; a '\0' is put at the end of the text
+ *  @return The number of characters written, not counting the '\0'
+ */
+
+unsigned char format_signed_long (long num, unsigned char base, char* p_out)
+    {
+    if (base == 10 && num < 0)
+        {
+        *p_out = '-';
+        return (1 + format_long (0UL - (unsigned long)num, base, p_out + 1));
+        }
+
+    return (format_long ((unsigned long)num, base, p_out));
+    }
@@ -0,0 +1,40 @@
+//*************************************************************************************
+/** \file num_format.h
+ *        This file contains functions which convert numbers to text in binary, octal,
+ *        decimal, or hexadecimal. They're used by the serial classes in place of the
+ *        C library's utoa() and ltoa(), which divide once for every digit; division
+ *        is very slow on an AVR, which has no divide instruction. Decimal digits are
+ *        found by subtracting powers of ten, and the other bases are done by shifting
+ *        bits. The digits come out most significant first, in one pass, so they can
+ *        be sent straight out once the conversion is done.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ *      \li 10-16-26       Added signed numbers, shared by all the serial classes
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _NUM_FORMAT_H_
+#define _NUM_FORMAT_H_
+
+
+/** This is the size of a buffer which can hold any number these functions make: 32
+ *  binary digits, a minus sign, and the '\\0' at the end
+ */
+#define NUM_FORMAT_SIZE     34
+
+
+// This function converts a 16-bit number to text; binary numbers are 'bits' digits
+unsigned char format_int (unsigned int num, unsigned char base, unsigned char bits,
+                          char* p_out);
+
+// This function converts a 32-bit number to text
+unsigned char format_long (unsigned long num, unsigned char base, char* p_out);
+
+// These functions convert 8 or 16-bit and 32-bit signed numbers to text
+unsigned char format_signed (int num, unsigned char base, unsigned char bits,
+                             char* p_out);
+unsigned char format_signed_long (long num, unsigned char base, char* p_out);
+
+#endif  // _NUM_FORMAT_H_
@@ -0,0 +1,56 @@
+//*************************************************************************************
+/** \file perf_counters.h
+ *        This file contains counters which record how the A/D converter and serial
+ *        ports are doing: how many conversions have been done and how long they took
+ *        to wait for, how long the transmitter had to wait for room, how many
+ *        characters timed out or were lost, and how many were sent. The numbers can
+ *        be used to pick buffer sizes and baud rates from real data.
+ *
+ *        The counters cost RAM and a little time in the drivers, so they are only
+ *        compiled in if PERF_COUNTERS is defined, which can be done by adding
+ *        -DPERF_COUNTERS to DEBUG_CODES in the Makefile. Code which updates a counter
+ *        is put inside PERF_COUNT() so that it disappears when they're turned off.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _PERF_COUNTERS_H_
+#define _PERF_COUNTERS_H_
+
+#ifdef PERF_COUNTERS
+    #define PERF_COUNT(code)    code        ///< Counters on; the code is compiled
+#else
+    #define PERF_COUNT(code)                ///< Counters off; the code disappears
+#endif
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the performance counters for an A/D converter.
+ */
+
+typedef struct
+    {
+    unsigned long conversions;              ///< Conversions which have finished
+    unsigned long wait_total;               ///< Polling loops spent waiting, in total
+    unsigned int wait_max;                  ///< Most polling loops for one conversion
+    unsigned int waited;                    ///< Conversions which were waited for
+    } adc_counters;
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the performance counters for a serial port.
+ */
+
+typedef struct
+    {
+    unsigned long bytes_sent;               ///< Characters written to the UART
+    unsigned long tx_stall;                 ///< Loops spent waiting for room to send
+    unsigned int tx_timeouts;               ///< Characters thrown away after waiting
+    unsigned int tx_dropped;                ///< Characters lost because a buffer was full
+    unsigned int rx_overruns;               ///< Characters received but lost
+    } serial_counters;
+
+#endif  // _PERF_COUNTERS_H_
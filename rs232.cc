@@ -3,9 +3,9 @@
  *        This file contains functions which allow the use of a serial port on an AVR 
  *        microcontroller. 
  *
- *        This code is designed to work for low-performance applications without 
- *        requiring the use of interrupts.  Interrupt based receiving code has not 
- *        been completed or tested.
+ *        This code works without interrupts by default. For busier programs, the
+ *        transmitter and receiver can each be switched to interrupt driven mode, in 
+ *        which characters go through buffers in memory. 
  *
  *  Revised:
  *      \li 04-03-06  JRR  For updated version of compiler
@@ -18,20 +18,32 @@
  *      \li 07-19-07  JRR  Changed some character return values to bool, added m324p
  *      \li 01-12-08  JRR  Added code for the ATmega128 using USART number 1 only
  *      \li 02-14-08  JRR  Split between base_text_serial and rs232 files
+ *      \li 10-16-26       Added interrupt driven transmit and receive buffers
+ *      \li 10-16-26       Added write() which sends a whole block at once
+ *      \li 10-16-26       Added a constructor taking a computed baud rate setting
  */
 //*************************************************************************************
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "rs232.h"
 
 
+/** These pointers let the interrupt service routines find the serial port objects
+ *  which belong to the UART's on the chip
+ */
+
+static rs232* p_isr_ports[2] = { NULL, NULL };
+
+
 //-------------------------------------------------------------------------------------
-/** This method sets up the AVR UART for communications.  It enables the appropriate 
- *  inputs and outputs and sets the baud rate divisor, and it saves pointers to the
- *  registers which are used to operate the serial port. Since some AVR processors
- *  have dual serial ports, this method allows one to specify a port number. 
+/** This constructor sets up the AVR UART for communications, given a raw baud rate
+ *  divisor. The divisor is put in the UBRR register as it is, and double speed mode
+ *  isn't used. Since some AVR processors have dual serial ports, this method allows
+ *  one to specify a port number. 
  *  @param divisor The baud rate divisor to be used for controlling the rate of
  *      communication 
  *  @param port_number The number of the serial port, 0 or 1 (the second port numbered
@@ -41,6 +53,51 @@
 rs232::rs232 (unsigned char divisor, unsigned char port_number)
     : base_text_serial ()
     {
+    setup (divisor, false, port_number);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor sets up the AVR UART for communications at a baud rate worked out
+ *  by the uart_baud template, which picks the divisor and whether to use double speed
+ *  mode at compile time. For example, for 115200 baud on port 1:
+ *  \code
+ *    rs232 the_serial_port (uart_baud<F_CPU, 115200> (), 1);
+ *  \endcode
+ *  @param setting The baud rate setting
+ *  @param port_number The number of the serial port, 0 or 1. The default is port 0
+ */
+
+rs232::rs232 (const uart_setting& setting, unsigned char port_number)
+    : base_text_serial ()
+    {
+    setup (setting.divisor, setting.double_speed, port_number);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets up the UART. It enables the appropriate inputs and outputs, sets
+ *  the baud rate divisor and speed mode, and saves pointers to the registers which
+ *  are used to operate the serial port. 
+ *  @param divisor The value for the UBRR registers, up to 4095
+ *  @param double_speed True to set the U2X bit, which halves the divisor's clock
+ *  @param port_number The number of the serial port, 0 or 1
+ */
+
+void rs232::setup (unsigned int divisor, bool double_speed, unsigned char port_number)
+    {
+    // Characters are sent one at a time, without interrupts, until asked otherwise
+    tx_buffered = false;
+    tx_policy = TX_BLOCK;
+    tx_head = 0;
+    tx_tail = 0;
+    rx_buffered = false;
+    rx_head = 0;
+    rx_tail = 0;
+    rx_overrun_count = 0;
+    PERF_COUNT (clear_counters ());
+    p_isr_ports[port_number & 0x01] = this;
+
     if (port_number == 0)
         {
         #ifdef __AVR_AT90S2313__
@@ -48,27 +105,29 @@ rs232::rs232 (unsigned char divisor, unsigned char port_number)
             p_USR = &USR;
             p_UCR = &UCR;
             UCR = 0x18;                     // Mode N81
-            UBRR = divisor;
+            UBRR = divisor;                 // This one has no double speed mode
         #endif
         #if defined __AVR_ATmega8__ || defined __AVR_ATmega8535__ \
             || defined __AVR_ATmega32__
             p_UDR = &UDR;
             p_USR = &UCSRA;
             p_UCR = &UCSRB;
+            UCSRA = double_speed ? (1 << U2X) : 0;
             UCSRB = 0x18;
             UCSRC = 0x86;
-            UBRRH = 0x00;
-            UBRRL = divisor;
+            UBRRH = (unsigned char)(divisor >> 8);
+            UBRRL = (unsigned char)divisor;
         #endif
         #if defined __AVR_ATmega644__ || defined __AVR_ATmega324P__ \
             || defined __AVR_ATmega128__
             p_UDR = &UDR0;
             p_USR = &UCSR0A;
             p_UCR = &UCSR0B;
+            UCSR0A = double_speed ? (1 << U2X0) : 0;
             UCSR0B = 0x18;
             UCSR0C = 0x86;
-            UBRR0H = 0x00;
-            UBRR0L = divisor;
+            UBRR0H = (unsigned char)(divisor >> 8);
+            UBRR0L = (unsigned char)divisor;
         #endif
         }
     else
@@ -84,20 +143,17 @@ rs232::rs232 (unsigned char divisor, unsigned char port_number)
             p_UDR = &UDR1;
             p_USR = &UCSR1A;
             p_UCR = &UCSR1B;
+            UCSR1A = double_speed ? (1 << U2X1) : 0;
             UCSR1B = 0x18;
             UCSR1C = 0x86;
-            UBRR1H = 0x00;
-            UBRR1L = divisor;
+            UBRR1H = (unsigned char)(divisor >> 8);
+            UBRR1L = (unsigned char)divisor;
         #endif
         }
 
     // Read the data register to ensure that it's empty
     port_number = *p_UDR;
     port_number = *p_UDR;
-
-//     #ifdef UART_DOUBLE_SPEED                // If double-speed macro has been defined,
-//         UART_STATUS |= 0x02;                // Turn on double-speed operation
-//     #endif
     }
 
 
@@ -109,6 +165,10 @@ rs232::rs232 (unsigned char divisor, unsigned char port_number)
 
 bool rs232::ready_to_send (void)
     {
+    // If buffered, we're ready as long as there's room in the buffer
+    if (tx_buffered)
+        return (((tx_head + 1) & (UART_TX_BUF_SIZE - 1)) != tx_tail);
+
     // If transmitter buffer is full, we're not ready to send
     if (*p_USR & UDRE_MASK)
         return (true);
@@ -134,12 +194,63 @@ bool rs232::putchar (char chout)
     {
     unsigned int count = 0;                 // Timeout counter
 
+    // In buffered mode the character just goes into the buffer
+    if (tx_buffered)
+        {
+        unsigned char next = (tx_head + 1) & (UART_TX_BUF_SIZE - 1);
+
+        if (next == tx_tail)
+            {
+            if (tx_policy == TX_DROP)
+                {
+                PERF_COUNT (perf.tx_dropped++);
+                return (false);
+                }
+            else if (tx_policy == TX_OVERWRITE)
+                {
+                // The ISR also moves the tail, so keep it out while we do so
+                unsigned char sreg = SREG;
+                cli ();
+                if (next == tx_tail)
+                    {
+                    tx_tail = (tx_tail + 1) & (UART_TX_BUF_SIZE - 1);
+                    PERF_COUNT (perf.tx_dropped++);
+                    }
+                SREG = sreg;
+                }
+            else
+                {
+                for (count = 0; next == tx_tail; count++)
+                    {
+                    if (count > UART_TX_TOUT)
+                        {
+                        PERF_COUNT (perf.tx_stall += count);
+                        PERF_COUNT (perf.tx_timeouts++);
+                        return (false);
+                        }
+                    }
+                PERF_COUNT (perf.tx_stall += count);
+                }
+            }
+
+        tx_buffer[tx_head] = chout;
+        tx_head = next;
+        *p_UCR |= UDRIE_MASK;               // Make sure the ISR will send it
+        return (true);
+        }
+
     // Now wait for the serial port transmitter buffer to be empty     
     for (count = 0; ((*p_USR & UDRE_MASK) == 0); count++)
         {
         if (count > UART_TX_TOUT)
+            {
+            PERF_COUNT (perf.tx_stall += count);
+            PERF_COUNT (perf.tx_timeouts++);
             return (false);
+            }
         }
+    PERF_COUNT (perf.tx_stall += count);
+    PERF_COUNT (perf.bytes_sent++);
 
     // The CTS line is 0 and the transmitter buffer is empty, so send the character
     *p_UDR = chout;
@@ -149,13 +260,86 @@ bool rs232::putchar (char chout)
 
 //-------------------------------------------------------------------------------------
 /** This method writes all the characters in a string until it gets to the '\\0' at 
- *  the end. Warning: This function blocks until it's finished. 
+ *  the end. Warning: This function blocks until it's finished, unless the port is in
+ *  buffered mode; then it only blocks if the buffer fills up. 
  *  @param str The string to be written 
  */
 
 void rs232::puts (char const* str)
     {
-    while (*str) putchar (*str++);
+    write (str, strlen (str));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends a block of bytes, which may include zeros. Without the buffer,
+ *  it waits for the transmitter before each byte in one tight loop, with no calls
+ *  in between. In buffered mode, as much of the block as there's room for is copied
+ *  into the buffer at once and the interrupt is turned on; when the buffer is full,
+ *  the next byte goes through putchar(), which deals with it as the full buffer
+ *  policy says and then the copying goes on. 
+ *  @param p_data Pointer to the first byte to be sent
+ *  @param length The number of bytes to send
+ *  @return True if all the bytes were sent or buffered, false if any were lost
+ */
+
+bool rs232::write (const void* p_data, size_t length)
+    {
+    const char* p_char = (const char*)p_data;
+    bool all_sent = true;
+
+    if (tx_buffered)
+        {
+        while (length > 0)
+            {
+            // Only this method and putchar() move the head, so the room can only
+            // grow while we copy, as the ISR sends characters from the tail
+            unsigned char head = tx_head;
+            unsigned char room = (tx_tail - head - 1) & (UART_TX_BUF_SIZE - 1);
+
+            if (room == 0)
+                {
+                if (!putchar (*p_char++))
+                    all_sent = false;
+                length--;
+                continue;
+                }
+
+            if (room > length)
+                room = length;
+            length -= room;
+            while (room--)
+                {
+                tx_buffer[head] = *p_char++;
+                head = (head + 1) & (UART_TX_BUF_SIZE - 1);
+                }
+            tx_head = head;
+            *p_UCR |= UDRIE_MASK;           // Make sure the ISR will send them
+            }
+
+        return (all_sent);
+        }
+
+    while (length--)
+        {
+        unsigned int count;
+
+        for (count = 0; ((*p_USR & UDRE_MASK) == 0); count++)
+            {
+            if (count > UART_TX_TOUT)
+                {
+                PERF_COUNT (perf.tx_stall += count);
+                PERF_COUNT (perf.tx_timeouts++);
+                return (false);
+                }
+            }
+        PERF_COUNT (perf.tx_stall += count);
+        PERF_COUNT (perf.bytes_sent++);
+
+        *p_UDR = *p_char++;
+        }
+
+    return (true);
     }
 
 
@@ -169,14 +353,56 @@ void rs232::puts (char const* str)
 
 char rs232::getchar (void)
     {
+    // In buffered mode, wait for the ISR to put something in the buffer
+    if (rx_buffered)
+        {
+        while (rx_head == rx_tail);
+
+        char ch_in = rx_buffer[rx_tail];
+        rx_tail = (rx_tail + 1) & (UART_RX_BUF_SIZE - 1);
+        return (ch_in);
+        }
+
     //  Wait until there's something in the receiver buffer
-    while ((*p_USR & RXC_MASK) == 0);
+    unsigned char status;
+    while (((status = *p_USR) & RXC_MASK) == 0);
+
+    //  The status must be read before the data; if the UART lost one before this
+    //  one because it wasn't read in time, count it as the ISR does
+    if (status & DOR_MASK)
+        {
+        unsigned char sreg = SREG;
+        cli ();
+        rx_overrun_count++;
+        SREG = sreg;
+        }
 
     //  Return the character retreived from the buffer
     return (*p_UDR);
     }
 
 
+//-------------------------------------------------------------------------------------
+/** This method gets one character from the serial port, but unlike getchar(void) it
+ *  only waits a limited time for one to arrive. 
+ *  @param ch_in A reference to the variable into which the character will be put
+ *  @param tries The number of times to check for a character before giving up
+ *  @return True if a character was received, false if the wait timed out
+ */
+
+bool rs232::getchar (char& ch_in, unsigned int tries)
+    {
+    for (unsigned int count = 0; !check_for_char (); count++)
+        {
+        if (count >= tries)
+            return (false);
+        }
+
+    ch_in = getchar ();
+    return (true);
+    }
+
+
 //-------------------------------------------------------------------------------------
 /** This function checks if there is a character in the serial port's receiver buffer.
  *  It returns 1 if there's a character available, and 0 if not. 
@@ -185,8 +411,248 @@ char rs232::getchar (void)
 
 bool rs232::check_for_char (void)
     {
+    if (rx_buffered)
+        return (rx_head != rx_tail);
+
     if (*p_USR & RXC_MASK)
         return (true);
     else
         return (false);
     }
+
+
+//-------------------------------------------------------------------------------------
+/** This method switches the port to interrupt driven transmission. From then on, 
+ *  putchar() and puts() only put characters into a buffer, and the transmitter empty
+ *  interrupt sends them out in the background. Interrupts must be globally enabled 
+ *  with sei() for anything to actually be sent. 
+ *  @param policy What to do with characters when the buffer is full: TX_BLOCK waits
+ *      for room, TX_DROP throws away the new character, and TX_OVERWRITE throws away
+ *      the oldest character in the buffer
+ */
+
+void rs232::use_tx_buffer (tx_full_policy policy)
+    {
+    tx_policy = policy;
+    tx_head = 0;
+    tx_tail = 0;
+    tx_buffered = true;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method switches the port to interrupt driven receiving. Characters which come
+ *  in are put into a buffer by the receive complete interrupt, so they aren't lost if
+ *  the program is busy for a while; check_for_char() and getchar() then read from the
+ *  buffer. Interrupts must be globally enabled with sei(). 
+ */
+
+void rs232::use_rx_buffer (void)
+    {
+    rx_head = 0;
+    rx_tail = 0;
+    rx_buffered = true;
+    *p_UCR |= RXCIE_MASK;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the number of received characters which have been lost, either
+ *  because the UART overran before the ISR or getchar() got to it, or because the
+ *  buffer was full. 
+ *  @return The number of characters lost since the object was made
+ */
+
+unsigned int rs232::rx_overruns (void)
+    {
+    unsigned char sreg = SREG;              // The count is two bytes, so keep the ISR
+    cli ();                                 // from changing it half way through
+    unsigned int count = rx_overrun_count;
+    SREG = sreg;
+
+    return (count);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method waits until everything in the transmitter buffer has been sent. It 
+ *  gives up if no character has gone out for UART_TX_TOUT tries, which would mean 
+ *  that interrupts are turned off or the port is stuck. 
+ */
+
+void rs232::transmit_now (void)
+    {
+    if (!tx_buffered)
+        return;
+
+    unsigned char last_tail = tx_tail;
+
+    for (unsigned int count = 0; tx_head != tx_tail; count++)
+        {
+        if (tx_tail != last_tail)           // A character went out, so start the
+            {                               // timeout over again
+            last_tail = tx_tail;
+            count = 0;
+            }
+        else if (count > UART_TX_TOUT)
+            return;
+        }
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method is called by the transmitter empty interrupt. It sends the next 
+ *  character in the buffer, or turns off the interrupt if the buffer is empty. 
+ */
+
+void rs232::tx_interrupt (void)
+    {
+    if (tx_head == tx_tail)
+        {
+        *p_UCR &= ~UDRIE_MASK;
+        return;
+        }
+
+    *p_UDR = tx_buffer[tx_tail];
+    tx_tail = (tx_tail + 1) & (UART_TX_BUF_SIZE - 1);
+    PERF_COUNT (perf.bytes_sent++);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method is called by the receive complete interrupt. It puts the character 
+ *  which came in into the receiver buffer, or counts it as lost if there's no room.
+ */
+
+void rs232::rx_interrupt (void)
+    {
+    unsigned char status = *p_USR;          // The status must be read before the data
+    char ch_in = *p_UDR;
+
+    if (status & DOR_MASK)                  // The UART lost one before this one
+        rx_overrun_count++;
+
+    unsigned char next = (rx_head + 1) & (UART_RX_BUF_SIZE - 1);
+    if (next == rx_tail)
+        rx_overrun_count++;
+    else
+        {
+        rx_buffer[rx_head] = ch_in;
+        rx_head = next;
+        }
+    }
+
+
+#ifdef PERF_COUNTERS
+//-------------------------------------------------------------------------------------
+/** This method copies the performance counters, holding off interrupts so the ISR's
+ *  can't change them half way through. The count of lost received characters is kept
+ *  whether or not counters are compiled in, and is copied along with the rest. 
+ *  @param copy A reference to the structure into which the counters are copied
+ */
+
+void rs232::get_counters (serial_counters& copy)
+    {
+    unsigned char sreg = SREG;
+    cli ();
+    copy.bytes_sent = perf.bytes_sent;
+    copy.tx_stall = perf.tx_stall;
+    copy.tx_timeouts = perf.tx_timeouts;
+    copy.tx_dropped = perf.tx_dropped;
+    copy.rx_overruns = rx_overrun_count;
+    SREG = sreg;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets the performance counters back to zero. 
+ */
+
+void rs232::clear_counters (void)
+    {
+    unsigned char sreg = SREG;
+    cli ();
+    perf.bytes_sent = 0;
+    perf.tx_stall = 0;
+    perf.tx_timeouts = 0;
+    perf.tx_dropped = 0;
+    SREG = sreg;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This operator prints a serial port's performance counters on a serial device. 
+ *  @param serial A reference to the serial-type object to which to print
+ *  @param counters A reference to the counters, from rs232::get_counters()
+ */
+
+base_text_serial& operator<< (base_text_serial& serial, const serial_counters& counters)
+    {
+    serial << FLASH_STR ("Bytes sent: ") << counters.bytes_sent 
+           << FLASH_STR (" TX stall loops: ") << counters.tx_stall << endl
+           << FLASH_STR ("TX timeouts: ") << counters.tx_timeouts 
+           << FLASH_STR (" dropped: ") << counters.tx_dropped
+           << FLASH_STR (" RX overruns: ") << counters.rx_overruns << endl;
+
+    return (serial);
+    }
+#endif // PERF_COUNTERS
+
+
+//-------------------------------------------------------------------------------------
+// These are the transmitter empty and receive complete interrupt service routines. 
+// They just hand the work to the serial port objects. 
+
+#if defined __AVR_ATmega644__ || defined __AVR_ATmega324P__ \
+    || defined __AVR_ATmega128__
+    ISR (USART0_UDRE_vect)
+        {
+        if (p_isr_ports[0] != NULL)
+            p_isr_ports[0]->tx_interrupt ();
+        }
+    ISR (USART0_RX_vect)
+        {
+        if (p_isr_ports[0] != NULL)
+            p_isr_ports[0]->rx_interrupt ();
+        }
+#endif
+#if defined __AVR_ATmega324P__ || defined __AVR_ATmega128__
+    ISR (USART1_UDRE_vect)
+        {
+        if (p_isr_ports[1] != NULL)
+            p_isr_ports[1]->tx_interrupt ();
+        }
+    ISR (USART1_RX_vect)
+        {
+        if (p_isr_ports[1] != NULL)
+            p_isr_ports[1]->rx_interrupt ();
+        }
+#endif
+#if defined __AVR_ATmega8__ || defined __AVR_ATmega8535__ || defined __AVR_ATmega32__
+    ISR (USART_UDRE_vect)
+        {
+        if (p_isr_ports[0] != NULL)
+            p_isr_ports[0]->tx_interrupt ();
+        }
+    #ifdef __AVR_ATmega8535__
+        ISR (USART_RX_vect)
+    #else
+        ISR (USART_RXC_vect)
+    #endif
+        {
+        if (p_isr_ports[0] != NULL)
+            p_isr_ports[0]->rx_interrupt ();
+        }
+#endif
+#ifdef __AVR_AT90S2313__
+    ISR (UART_UDRE_vect)
+        {
+        if (p_isr_ports[0] != NULL)
+            p_isr_ports[0]->tx_interrupt ();
+        }
+    ISR (UART_RX_vect)
+        {
+        if (p_isr_ports[0] != NULL)
+            p_isr_ports[0]->rx_interrupt ();
+        }
+#endif
@@ -3,9 +3,9 @@
  *        This file contains functions which allow the use of a serial port on an AVR 
  *        microcontroller. 
  *
- *        This code is designed to work for low-performance applications without 
- *        requiring the use of interrupts.  Interrupt based receiving code has not 
- *        been completed or tested.
+ *        This code works without interrupts by default. For busier programs, the
+ *        transmitter and receiver can each be switched to interrupt driven mode, in 
+ *        which characters go through buffers in memory. 
  *
  *  Revised:
  *      \li 04-03-06  JRR  For updated version of compiler
@@ -18,6 +18,9 @@
  *      \li 07-19-07  JRR  Changed some character return values to bool, added m324p
  *      \li 01-12-08  JRR  Added code for the ATmega128 using USART number 1 only
  *      \li 02-14-08  JRR  Split between base_text_serial and rs232 files
+ *      \li 10-16-26       Added interrupt driven transmit and receive buffers
+ *      \li 10-16-26       Added write() which sends a whole block at once
+ *      \li 10-16-26       Added a constructor taking a computed baud rate setting
  */
 //*************************************************************************************
 
@@ -26,6 +29,8 @@
 #define _RS232_H_
 
 #include "base_text_serial.h"               // Pull in the base class header file
+#include "perf_counters.h"                  // Optional performance counters
+#include "uart_baud.h"                      // Baud rate settings from the compiler
 
 
 //-------------------------------------------------------------------------------------
@@ -35,31 +40,75 @@
 #ifdef __AVR_AT90S2313__                    // For the AT90S2313 processor
     #define UDRE_MASK (1 << UDRE)           // Mask for transmitter empty
     #define RXC_MASK (1 << RXC)             // Mask for receive complete
+    #define UDRIE_MASK (1 << UDRIE)         // Mask for transmitter empty interrupt
+    #define RXCIE_MASK (1 << RXCIE)         // Mask for receive complete interrupt
+    #define DOR_MASK (1 << OR)              // Mask for receiver data overrun
 #endif
 #ifdef __AVR_ATmega8__                      // For the ATMega8 processor
     #define UDRE_MASK (1 << UDRE)           // Mask for transmitter empty
     #define RXC_MASK (1 << RXC)             // Mask for receive complete
+    #define UDRIE_MASK (1 << UDRIE)         // Mask for transmitter empty interrupt
+    #define RXCIE_MASK (1 << RXCIE)         // Mask for receive complete interrupt
+    #define DOR_MASK (1 << DOR)             // Mask for receiver data overrun
 #endif
 #ifdef __AVR_ATmega8535__                   // For the old ATMega8535 processor
     #define UDRE_MASK (1 << UDRE)           // Mask for transmitter empty
     #define RXC_MASK (1 << RXC)             // Mask for receive complete
+    #define UDRIE_MASK (1 << UDRIE)         // Mask for transmitter empty interrupt
+    #define RXCIE_MASK (1 << RXCIE)         // Mask for receive complete interrupt
+    #define DOR_MASK (1 << DOR)             // Mask for receiver data overrun
 #endif // __AVR_ATmega8535__
 #ifdef __AVR_ATmega32__                     // For the ATMega32 processor
     #define UDRE_MASK (1 << UDRE)           // Mask for transmitter empty
     #define RXC_MASK (1 << RXC)             // Mask for receive complete
+    #define UDRIE_MASK (1 << UDRIE)         // Mask for transmitter empty interrupt
+    #define RXCIE_MASK (1 << RXCIE)         // Mask for receive complete interrupt
+    #define DOR_MASK (1 << DOR)             // Mask for receiver data overrun
 #endif // __AVR_ATmega32__
 #if (defined __AVR_ATmega644__ || defined __AVR_ATmega324P__)
     #define UDRE_MASK (1 << UDRE0)          // Mask for transmitter empty
     #define RXC_MASK (1 << RXC0)            // Mask for receive complete
+    #define UDRIE_MASK (1 << UDRIE0)        // Mask for transmitter empty interrupt
+    #define RXCIE_MASK (1 << RXCIE0)        // Mask for receive complete interrupt
+    #define DOR_MASK (1 << DOR0)            // Mask for receiver data overrun
 #endif // ...324 or 644...
 #ifdef __AVR_ATmega128__                    // For the big ATMega128 processor
     #define UDRE_MASK (1 << UDRE0)          // Mask for transmitter empty
     #define RXC_MASK (1 << RXC0)            // Mask for receive complete
+    #define UDRIE_MASK (1 << UDRIE0)        // Mask for transmitter empty interrupt
+    #define RXCIE_MASK (1 << RXCIE0)        // Mask for receive complete interrupt
+    #define DOR_MASK (1 << DOR0)            // Mask for receiver data overrun
 #endif // __AVR_ATmega128__
 
 
-/** The number of tries to wait for the transmitter buffer to become empty */
-#define UART_TX_TOUT        20000
+/** The number of tries to wait for the transmitter buffer to become empty. It can be
+ *  set on the compiler command line for faster or slower processors
+ */
+#ifndef UART_TX_TOUT
+    #define UART_TX_TOUT    20000
+#endif
+
+/** The size of the transmitter buffer used when transmission is interrupt driven. It
+ *  must be a power of two no bigger than 128
+ */
+#define UART_TX_BUF_SIZE    64
+
+/** The size of the receiver buffer used when receiving is interrupt driven. It must be
+ *  a power of two no bigger than 128
+ */
+#define UART_RX_BUF_SIZE    32
+
+
+//-------------------------------------------------------------------------------------
+/** This enumeration tells a buffered serial port what to do with a character when the
+ *  transmitter buffer is full. 
+ */
+
+typedef enum {
+    TX_BLOCK,               ///< Wait for room in the buffer, up to UART_TX_TOUT tries
+    TX_DROP,                ///< Throw away the new character
+    TX_OVERWRITE            ///< Throw away the oldest character in the buffer
+    } tx_full_policy;
 
 
 //-------------------------------------------------------------------------------------
@@ -88,16 +137,82 @@ class rs232 : public base_text_serial
         /// This is a pointer to the control register used by the UART
         volatile unsigned char* p_UCR;
 
+        /// This is true if characters are sent from the buffer by the UDRE interrupt
+        bool tx_buffered;
+
+        /// This tells what to do with new characters when the transmitter buffer is full
+        tx_full_policy tx_policy;
+
+        /// This buffer holds characters waiting to be sent by the interrupt routine
+        volatile char tx_buffer[UART_TX_BUF_SIZE];
+
+        /// This is the index in the transmitter buffer where the next character goes
+        volatile unsigned char tx_head;
+
+        /// This is the index in the transmitter buffer of the next character to send
+        volatile unsigned char tx_tail;
+
+        /// This is true if received characters are put in a buffer by an interrupt
+        bool rx_buffered;
+
+        /// This buffer holds characters which have been received but not yet read
+        volatile char rx_buffer[UART_RX_BUF_SIZE];
+
+        /// This is the index in the receiver buffer where the ISR puts the next character
+        volatile unsigned char rx_head;
+
+        /// This is the index in the receiver buffer of the next character to be read
+        volatile unsigned char rx_tail;
+
+        /// This counts characters lost because the UART or the buffer overflowed
+        volatile unsigned int rx_overrun_count;
+
+#ifdef PERF_COUNTERS
+        /// These count characters sent and the time spent waiting to send them
+        volatile serial_counters perf;
+#endif
+
+        // This method sets up the UART registers; both constructors use it
+        void setup (unsigned int, bool, unsigned char);
+
     // Public methods can be called from anywhere in the program where there is a 
     // pointer or reference to an object of this class
     public:
-        // The constructor sets up the UART, saving its baud divisor and location
+        // The constructors set up the UART, given a raw baud divisor or a setting
+        // worked out by uart_baud, and save its location
         rs232 (unsigned char, unsigned char = 0);
+        rs232 (const uart_setting&, unsigned char = 0);
         bool ready_to_send (void);          // Check if the port is ready to transmit
         bool putchar (char);                // Write one character to serial port
         void puts (char const*);            // Write a string constant to serial port
+        using base_text_serial::puts;       // Write a string from program memory
+        bool write (const void*, size_t);   // Write a block of bytes to serial port
         bool check_for_char (void);         // Check if a character is in the buffer
         char getchar (void);                // Get a character; wait if none is ready
+        bool getchar (char&, unsigned int); // Get a character, waiting a limited time
+        void transmit_now (void);           // Wait until the buffer has been sent
+
+        // This method turns on interrupt driven transmission from a buffer
+        void use_tx_buffer (tx_full_policy = TX_BLOCK);
+
+        // These methods turn on interrupt driven receiving and check for lost data
+        void use_rx_buffer (void);
+        unsigned int rx_overruns (void);
+
+        // These methods are called by the interrupt service routines
+        void tx_interrupt (void);
+        void rx_interrupt (void);
+
+#ifdef PERF_COUNTERS
+        // These methods read and reset the performance counters
+        void get_counters (serial_counters&);
+        void clear_counters (void);
+#endif
     };
 
+#ifdef PERF_COUNTERS
+/// This operator prints the serial port performance counters
+base_text_serial& operator<< (base_text_serial&, const serial_counters&);
+#endif
+
 #endif  // _RS232_H_
@@ -0,0 +1,214 @@
+//*************************************************************************************
+/** \file rs232_port.h
+ *        This file contains a serial port class whose port number is a template
+ *        parameter, so it uses the UART's registers directly instead of through
+ *        pointers picked when the program runs, and it has no virtual functions.
+ *        Printing a number or a string with it comes down to the number conversion
+ *        and a loop which writes straight to UDRn. Asking for a port which the chip
+ *        doesn't have won't compile.
+ *
+ *        This class only sends and receives without interrupts. The interrupt
+ *        driven buffers, the performance counters, and printing through a
+ *        base_text_serial reference are all in the rs232 class; a program can use
+ *        an rs232 on one port and an rs232_port on the other.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ *      \li 10-16-26       Added a constructor taking a computed baud rate setting
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _RS232_PORT_H_
+#define _RS232_PORT_H_
+
+#include <avr/io.h>
+#include "rs232.h"                          // For the bit masks and UART_TX_TOUT
+#include "text_stream.h"                    // Template which adds the << operators
+
+
+//-------------------------------------------------------------------------------------
+/** This template gives the registers which belong to a UART. Only the ports which the
+ *  chip has are defined, so using any other port number is a compiler error.
+ *  @param PORT The number of the serial port
+ */
+
+template <unsigned char PORT> struct uart_registers;
+
+#if defined __AVR_ATmega644__ || defined __AVR_ATmega324P__ \
+    || defined __AVR_ATmega128__
+    /// These are the registers of USART 0
+    template <> struct uart_registers<0>
+        {
+        static volatile unsigned char& data (void) { return (UDR0); }
+        static volatile unsigned char& status (void) { return (UCSR0A); }
+        static volatile unsigned char& control (void) { return (UCSR0B); }
+        static void setup (unsigned int divisor, bool double_speed)
+            {
+            UCSR0A = double_speed ? (1 << U2X0) : 0;
+            UCSR0B = 0x18;
+            UCSR0C = 0x86;
+            UBRR0H = (unsigned char)(divisor >> 8);
+            UBRR0L = (unsigned char)divisor;
+            }
+        };
+#endif
+#if defined __AVR_ATmega324P__ || defined __AVR_ATmega128__
+    /// These are the registers of USART 1
+    template <> struct uart_registers<1>
+        {
+        static volatile unsigned char& data (void) { return (UDR1); }
+        static volatile unsigned char& status (void) { return (UCSR1A); }
+        static volatile unsigned char& control (void) { return (UCSR1B); }
+        static void setup (unsigned int divisor, bool double_speed)
+            {
+            UCSR1A = double_speed ? (1 << U2X1) : 0;
+            UCSR1B = 0x18;
+            UCSR1C = 0x86;
+            UBRR1H = (unsigned char)(divisor >> 8);
+            UBRR1L = (unsigned char)divisor;
+            }
+        };
+#endif
+#if defined __AVR_ATmega8__ || defined __AVR_ATmega8535__ || defined __AVR_ATmega32__
+    /// These are the registers of the only USART
+    template <> struct uart_registers<0>
+        {
+        static volatile unsigned char& data (void) { return (UDR); }
+        static volatile unsigned char& status (void) { return (UCSRA); }
+        static volatile unsigned char& control (void) { return (UCSRB); }
+        static void setup (unsigned int divisor, bool double_speed)
+            {
+            UCSRA = double_speed ? (1 << U2X) : 0;
+            UCSRB = 0x18;
+            UCSRC = 0x86;
+            UBRRH = (unsigned char)(divisor >> 8);
+            UBRRL = (unsigned char)divisor;
+            }
+        };
+#endif
+#ifdef __AVR_AT90S2313__
+    /// These are the registers of the only UART
+    template <> struct uart_registers<0>
+        {
+        static volatile unsigned char& data (void) { return (UDR); }
+        static volatile unsigned char& status (void) { return (USR); }
+        static volatile unsigned char& control (void) { return (UCR); }
+        static void setup (unsigned int divisor, bool)
+            {
+            UCR = 0x18;                     // Mode N81
+            UBRR = divisor;                 // This one has no double speed mode
+            }
+        };
+#endif
+
+
+//-------------------------------------------------------------------------------------
+/** This class controls one UART, picked at compile time. It has the same << operators
+ *  as rs232, for example
+ *  \code
+ *    uart_baud<F_CPU, 115200> setting;
+ *    rs232_port<1> port (setting);
+ *    port << "Reading: " << value << endl;
+ *  \endcode
+ *  @param PORT The number of the serial port, 0 or 1
+ */
+
+template <unsigned char PORT>
+class rs232_port : public text_stream<rs232_port<PORT> >
+    {
+    protected:
+        /// These are the registers used by this port
+        typedef uart_registers<PORT> regs;
+
+        /// This method reads the data register twice to ensure that it's empty
+        void empty_receiver (void)
+            {
+            unsigned char ignored = regs::data ();
+            ignored = regs::data ();
+            (void)ignored;
+            }
+
+    public:
+        /** This constructor sets up the UART with a raw baud rate divisor, just as
+         *  the rs232 constructor does.
+         *  @param divisor The baud rate divisor
+         */
+        rs232_port (unsigned char divisor)
+            {
+            regs::setup (divisor, false);
+            empty_receiver ();
+            }
+
+        /** This constructor sets up the UART with a baud rate setting worked out by
+         *  the uart_baud template. The setting should be a named object, since
+         *  \c port (uart_baud<...> ()) would declare a function instead.
+         *  @param setting The baud rate setting
+         */
+        rs232_port (const uart_setting& setting)
+            {
+            regs::setup (setting.divisor, setting.double_speed);
+            empty_receiver ();
+            }
+
+        /** This method checks if the transmitter is ready to take a character.
+         *  @return True if the port is ready to send, and false if not
+         */
+        bool ready_to_send (void)
+            {
+            return ((regs::status () & UDRE_MASK) != 0);
+            }
+
+        /** This method sends one character, waiting up to UART_TX_TOUT tries for the
+         *  transmitter to be ready.
+         *  @param chout The character to be sent out
+         *  @return True if the character was sent and false if there was a timeout
+         */
+        bool putchar (char chout)
+            {
+            for (unsigned int count = 0; (regs::status () & UDRE_MASK) == 0; count++)
+                {
+                if (count > UART_TX_TOUT)
+                    return (false);
+                }
+
+            regs::data () = chout;
+            return (true);
+            }
+
+        /** This method writes all the characters in a string until the '\\0' at the
+         *  end. It blocks until the last one has gone into the UART.
+         *  @param str The string to be written
+         */
+        void puts (char const* str)
+            {
+            while (*str) putchar (*str++);
+            }
+
+        /** This method checks if a character has been received.
+         *  @return True for character available, false for no character available
+         */
+        bool check_for_char (void)
+            {
+            return ((regs::status () & RXC_MASK) != 0);
+            }
+
+        /** This method gets one character, waiting for one to arrive if need be.
+         *  @return The character which was received
+         */
+        char getchar (void)
+            {
+            while ((regs::status () & RXC_MASK) == 0);
+
+            return (regs::data ());
+            }
+
+        /** This method does nothing, since characters aren't buffered; it's here so
+         *  that send_now works as it does with other devices.
+         */
+        void transmit_now (void)
+            {
+            }
+    };
+
+#endif  // _RS232_PORT_H_
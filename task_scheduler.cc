@@ -0,0 +1,271 @@
+//*************************************************************************************
+/** \file task_scheduler.cc
+ *        This file contains a small cooperative scheduler which runs tasks at fixed
+ *        rates, timed by Timer 0, and sleeps between ticks. See task_scheduler.h for
+ *        a description of how it works.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ *      \li 10-16-26       Added checking a memory monitor's stack canary
+ */
+//*************************************************************************************
+
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "task_scheduler.h"
+
+
+/// This is a pointer to the scheduler which the timer interrupt routine works with
+static task_scheduler* p_isr_scheduler = NULL;
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor sets up a scheduler with no tasks. Timer 0 is put in CTC mode, in
+ *  which it counts up to SCHED_TIMER_TOP, interrupts, and starts again from zero, so
+ *  the ticks come at exactly SCHED_TICK_HZ no matter how long the tasks take. The
+ *  ticks don't start until interrupts are turned on with sei().
+ */
+
+task_scheduler::task_scheduler (void)
+    {
+    task_count = 0;
+    ticks = 0;
+    checked_tick = 0;
+    p_memory = NULL;
+    p_isr_scheduler = this;
+
+    #ifdef __AVR_ATmega128__
+        TCCR0 = (1 << WGM01) | (1 << CS02);             // CTC mode, divide by 64
+        OCR0 = SCHED_TIMER_TOP;
+        TIMSK |= (1 << OCIE0);
+    #elif defined __AVR_ATmega32__ || defined __AVR_ATmega8535__
+        TCCR0 = (1 << WGM01) | (1 << CS01) | (1 << CS00);
+        OCR0 = SCHED_TIMER_TOP;
+        TIMSK |= (1 << OCIE0);
+    #elif defined __AVR_ATmega644__ || defined __AVR_ATmega324P__
+        TCCR0A = (1 << WGM01);
+        TCCR0B = (1 << CS01) | (1 << CS00);
+        OCR0A = SCHED_TIMER_TOP;
+        TIMSK0 |= (1 << OCIE0A);
+    #else
+        #error The scheduler needs a Timer 0 with a compare match interrupt
+    #endif
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method adds a task to the list. Tasks are checked in the order in which they
+ *  were added, so a task which has to be run on time should be added first. The first
+ *  run is one period from now.
+ *  @param function The function which does the task
+ *  @param p_argument A pointer which is given to the function each time it's run
+ *  @param period The number of ticks between runs, from 1 to 32767
+ *  @return True if the task was added, false if the list is full
+ */
+
+bool task_scheduler::add_task (task_function function, void* p_argument,
+                               unsigned int period)
+    {
+    if (task_count >= SCHED_MAX_TASKS || period == 0)
+        return (false);
+
+    sched_task* p_task = &tasks[task_count];
+
+    p_task->function = function;
+    p_task->p_argument = p_argument;
+    p_task->period = period;
+    p_task->due = get_ticks () + period;
+    p_task->runs = 0;
+    p_task->overruns = 0;
+    task_count++;
+
+    return (true);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method gives the scheduler a memory monitor. Its stack canary is checked each
+ *  time the tasks are checked, so that the monitor's callback is called soon after
+ *  the stack runs into the variables.
+ *  @param p_monitor A pointer to the memory monitor, or NULL to stop checking
+ */
+
+void task_scheduler::watch_memory (mem_monitor* p_monitor)
+    {
+    p_memory = p_monitor;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method runs each task which is due. After a task has run, its next run is set
+ *  one period after the time at which this one was due, not after the time it really
+ *  ran, so that the rate doesn't drift. If that time has already come and gone, the
+ *  task has fallen a whole period behind; those runs are skipped and counted as
+ *  overruns, rather than run back to back to catch up.
+ *  @return True if any task was run
+ */
+
+bool task_scheduler::run_ready (void)
+    {
+    bool ran = false;
+
+    if (p_memory != NULL)
+        p_memory->check_canary ();
+
+    checked_tick = get_ticks ();
+    for (unsigned char index = 0; index < task_count; index++)
+        {
+        sched_task* p_task = &tasks[index];
+        unsigned int now = get_ticks ();
+
+        // The difference is looked at as signed so the tick count can wrap around
+        if ((int)(now - p_task->due) < 0)
+            continue;
+
+        p_task->function (p_task->p_argument);
+        p_task->runs++;
+        ran = true;
+
+        p_task->due += p_task->period;
+        while ((int)(now - p_task->due) >= 0)
+            {
+            p_task->due += p_task->period;
+            p_task->overruns++;
+            }
+        }
+
+    return (ran);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method puts the processor to sleep in idle mode until an interrupt wakes it.
+ *  Interrupts are turned off while checking for a tick, and turned on again by the
+ *  instruction just before the SLEEP; the AVR always runs the instruction after SEI
+ *  before any interrupt, so a tick can't sneak in between the check and the sleep
+ *  and leave the processor asleep with work to do. If a tick came while the tasks
+ *  were being checked, there's no sleep at all, so they can be checked again.
+ */
+
+void task_scheduler::sleep_until_tick (void)
+    {
+    set_sleep_mode (SLEEP_MODE_IDLE);
+    cli ();
+    if (ticks == checked_tick)
+        {
+        sleep_enable ();
+        sei ();
+        sleep_cpu ();
+        sleep_disable ();
+        }
+    sei ();
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method runs the tasks forever, sleeping whenever none of them is due. Other
+ *  interrupts, such as the A/D converter's or serial port's, wake the processor as
+ *  well; it just checks the tasks and goes back to sleep.
+ */
+
+void task_scheduler::run (void)
+    {
+    sei ();
+
+    while (true)
+        {
+        if (!run_ready ())
+            sleep_until_tick ();
+        }
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the number of ticks since the scheduler was made. The count is
+ *  two bytes, so interrupts are held off while it's read.
+ *  @return The tick count, which wraps around to zero after 65535
+ */
+
+unsigned int task_scheduler::get_ticks (void)
+    {
+    unsigned char sreg = SREG;
+    cli ();
+    unsigned int count = ticks;
+    SREG = sreg;
+
+    return (count);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the number of tasks which have been added.
+ *  @return The number of tasks
+ */
+
+unsigned char task_scheduler::get_task_count (void)
+    {
+    return (task_count);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method gives the scheduler's record of a task, so that its run and overrun
+ *  counts can be looked at.
+ *  @param index The number of the task, counting from 0 in the order they were added
+ *  @return A reference to the task's record
+ */
+
+const sched_task& task_scheduler::get_task (unsigned char index)
+    {
+    return (tasks[index]);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method is called by the timer interrupt routine once per tick.
+ */
+
+void task_scheduler::tick (void)
+    {
+    ticks++;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This is the Timer 0 compare match interrupt service routine. It just hands the
+ *  work to the scheduler object.
+ */
+
+#if defined __AVR_ATmega644__ || defined __AVR_ATmega324P__
+    ISR (TIMER0_COMPA_vect)
+#else
+    ISR (TIMER0_COMP_vect)
+#endif
+    {
+    if (p_isr_scheduler != NULL)
+        p_isr_scheduler->tick ();
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This operator prints a line for each task, giving how often it's supposed to run,
+ *  how many times it has run, and how many runs were skipped because it was late.
+ *  @param serial A reference to the serial-type object to which to print
+ *  @param scheduler A reference to the scheduler
+ */
+
+base_text_serial& operator<< (base_text_serial& serial, task_scheduler& scheduler)
+    {
+    for (unsigned char index = 0; index < scheduler.get_task_count (); index++)
+        {
+        const sched_task& task = scheduler.get_task (index);
+
+        serial << FLASH_STR ("Task ") << index << FLASH_STR (": every ") << task.period
+               << FLASH_STR (" ticks, ") << task.runs << FLASH_STR (" runs, ")
+               << task.overruns << FLASH_STR (" overruns") << endl;
+        }
+
+    return (serial);
+    }
@@ -0,0 +1,125 @@
+//*************************************************************************************
+/** \file task_scheduler.h
+ *        This file contains a small cooperative scheduler which runs tasks at fixed
+ *        rates. A hardware timer interrupts once per tick, and the scheduler runs each
+ *        task whose time has come; each task must do a little work and return. In
+ *        between ticks, when no task is ready, the processor sleeps in idle mode,
+ *        which saves power and leaves the interrupts to wake it up.
+ *
+ *        The tick is made by Timer 0 in CTC mode, interrupting on compare match. If a
+ *        task has to wait so long that its next run comes due too, the missed run is
+ *        skipped and counted as an overrun, so the task stays on its schedule.
+ *
+ *        The scheduler can be given a mem_monitor, whose stack canary it then checks
+ *        each time it checks the tasks.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ *      \li 10-16-26       Added checking a memory monitor's stack canary
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _TASK_SCHEDULER_H_
+#define _TASK_SCHEDULER_H_
+
+#include "base_text_serial.h"               // Pull in the base class header file
+#include "mem_monitor.h"                    // For checking the stack canary
+
+
+/// This is the number of scheduler ticks per second; a tick is one millisecond
+#define SCHED_TICK_HZ       1000
+
+/// This is the largest number of tasks the scheduler can run
+#define SCHED_MAX_TASKS     8
+
+/// This is the clock divider used by Timer 0 to make the ticks
+#define SCHED_PRESCALER     64
+
+#ifndef F_CPU
+    #error F_CPU must be set to the CPU clock frequency, for example in the Makefile
+#endif
+
+/// This is the compare value which makes Timer 0 interrupt once per tick
+#define SCHED_TIMER_TOP     (F_CPU / SCHED_PRESCALER / SCHED_TICK_HZ - 1)
+
+#if SCHED_TIMER_TOP > 255 || SCHED_TIMER_TOP < 1
+    #error The scheduler tick cannot be made by Timer 0 with this F_CPU and SCHED_TICK_HZ
+#endif
+
+
+/** This type of function is a task. It's given the pointer which was given when the
+ *  task was added, which can point to whatever object the task works on.
+ */
+typedef void (*task_function) (void*);
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds what the scheduler knows about one task.
+ */
+
+typedef struct
+    {
+    task_function function;                 ///< The function which does the task
+    void* p_argument;                       ///< The pointer given to the function
+    unsigned int period;                    ///< How many ticks between runs
+    unsigned int due;                       ///< The tick at which the next run is due
+    unsigned long runs;                     ///< How many times the task has run
+    unsigned int overruns;                  ///< How many runs were skipped for lateness
+    } sched_task;
+
+
+//-------------------------------------------------------------------------------------
+/** This class runs tasks at fixed rates, timed by ticks from Timer 0. Tasks are added
+ *  with add_task(), then run() is called; it never returns.
+ */
+
+class task_scheduler
+    {
+    protected:
+        /// This is the list of tasks, in the order in which they're checked
+        sched_task tasks[SCHED_MAX_TASKS];
+
+        /// This is how many tasks are in the list
+        unsigned char task_count;
+
+        /// This counts ticks; it's changed by the timer interrupt
+        volatile unsigned int ticks;
+
+        /// This is the tick count when the tasks were last checked
+        unsigned int checked_tick;
+
+        /// This is the memory monitor whose canary is checked, or NULL for none
+        mem_monitor* p_memory;
+
+    public:
+        // The constructor sets up Timer 0 to make the ticks
+        task_scheduler (void);
+
+        // This method adds a task to be run every given number of ticks
+        bool add_task (task_function, void*, unsigned int);
+
+        // This method gives a memory monitor whose canary is checked with the tasks
+        void watch_memory (mem_monitor*);
+
+        // These methods run the tasks: once for each which is due, or forever
+        bool run_ready (void);
+        void sleep_until_tick (void);
+        void run (void);
+
+        // These methods give the time and how the tasks are doing
+        unsigned int get_ticks (void);
+        unsigned char get_task_count (void);
+        const sched_task& get_task (unsigned char);
+
+        // This method is called by the timer compare match interrupt routine
+        void tick (void);
+    };
+
+
+//--------------------------------------------------------------------------------------
+/// This operator prints how many times each task has run and how many runs it missed
+
+base_text_serial& operator<< (base_text_serial&, task_scheduler&);
+
+#endif  // _TASK_SCHEDULER_H_
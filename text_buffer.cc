@@ -0,0 +1,173 @@
+//*************************************************************************************
+/** \file text_buffer.cc
+ *        This file contains a serial device which prints into a buffer in RAM and
+ *        passes the text on to other serial devices in bursts. See text_buffer.h.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+#include <stdlib.h>
+#include <string.h>
+#include "text_buffer.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor makes an empty buffer with no ports to pass the text on to.
+ *  @param fill_to The number of characters at which the text is passed on without
+ *      being asked; the default is when the buffer is full. Numbers larger than the
+ *      buffer or zero are taken to mean full
+ */
+
+text_buffer::text_buffer (unsigned char fill_to)
+    : base_text_serial ()
+    {
+    length = 0;
+    output_count = 0;
+    passed_on = 0;
+
+    if (fill_to == 0 || fill_to > TEXT_BUFFER_SIZE)
+        fill_to = TEXT_BUFFER_SIZE;
+    threshold = fill_to;
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method adds a serial device to which the text will be passed on. Each device
+ *  gets the text in the order in which they were added.
+ *  @param p_port A pointer to the serial device
+ *  @return True if the device was added, false if there are already too many
+ */
+
+bool text_buffer::add_output (base_text_serial* p_port)
+    {
+    if (output_count >= TEXT_MAX_OUTPUTS || p_port == NULL)
+        return (false);
+
+    p_outputs[output_count++] = p_port;
+    return (true);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method puts one character in the buffer.
+ *  @param chout The character to be put in the buffer
+ *  @return True if the ports took any text which had to be passed on to make room
+ */
+
+bool text_buffer::putchar (char chout)
+    {
+    return (write (&chout, 1));
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method copies a block of characters or bytes into the buffer. Whenever the
+ *  buffer fills up to the threshold, the text is passed on and copying goes on into
+ *  the empty buffer, so blocks longer than the buffer are fine.
+ *  @param p_data Pointer to the first byte to be written
+ *  @param count The number of bytes to write
+ *  @return True if the ports took everything that was passed on to them
+ */
+
+bool text_buffer::write (const void* p_data, size_t count)
+    {
+    const char* p_char = (const char*)p_data;
+    bool all_sent = true;
+
+    while (count > 0)
+        {
+        unsigned char room = threshold - length;
+
+        if (room > count)
+            room = count;
+        memcpy (buffer + length, p_char, room);
+        length += room;
+        p_char += room;
+        count -= room;
+
+        if (length >= threshold && !pass_on ())
+            all_sent = false;
+        }
+
+    return (all_sent);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method passes the text in the buffer on to each of the ports and empties the
+ *  buffer. It's called when send_now is printed. It doesn't wait for the ports to
+ *  finish sending; a port which buffers its own output can still be busy with it.
+ */
+
+void text_buffer::transmit_now (void)
+    {
+    pass_on ();
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method hands the text in the buffer to each port as one block, then empties
+ *  the buffer.
+ *  @return True if every port took all of the text
+ */
+
+bool text_buffer::pass_on (void)
+    {
+    bool all_sent = true;
+
+    for (unsigned char index = 0; index < output_count; index++)
+        if (!p_outputs[index]->write (buffer, length))
+            all_sent = false;
+
+    passed_on += length;
+    length = 0;
+
+    return (all_sent);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method gives the text which is in the buffer. It isn't null terminated; use
+ *  get_length() to find out how long it is.
+ *  @return A pointer to the first character in the buffer
+ */
+
+const char* text_buffer::get_text (void)
+    {
+    return (buffer);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method gives the number of characters in the buffer.
+ *  @return The number of characters which haven't been passed on yet
+ */
+
+unsigned char text_buffer::get_length (void)
+    {
+    return (length);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method gives the number of characters which have been passed on to the ports,
+ *  or thrown away at the threshold if there aren't any ports.
+ *  @return The number of characters since the buffer was made
+ */
+
+unsigned long text_buffer::get_passed_on (void)
+    {
+    return (passed_on);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method throws away the text in the buffer without passing it on.
+ */
+
+void text_buffer::clear (void)
+    {
+    length = 0;
+    }
@@ -0,0 +1,89 @@
+//*************************************************************************************
+/** \file text_buffer.h
+ *        This file contains a serial device which prints into a buffer in RAM
+ *        instead of to a port. A whole report can be put together there while the
+ *        UART is still busy, then passed on to one or more real ports in a burst,
+ *        so the same text goes to each of them without being formatted again. The
+ *        text is passed on when send_now is printed, when transmit_now() is called,
+ *        or when the buffer fills up to a chosen threshold. With no ports to pass it
+ *        on to, the buffer just holds the text, which is handy for timing the
+ *        formatting code on its own.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _TEXT_BUFFER_H_
+#define _TEXT_BUFFER_H_
+
+#include "base_text_serial.h"               // Pull in the base class header file
+
+
+/// This is the number of characters the buffer can hold
+#define TEXT_BUFFER_SIZE    128
+
+/// This is the largest number of ports to which the text can be passed on
+#define TEXT_MAX_OUTPUTS    3
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a serial device which keeps what's printed to it in RAM until it's
+ *  told to pass it on. For example, to send one report to two ports:
+ *  \code
+ *    text_buffer report;
+ *    report.add_output (&radio);
+ *    report.add_output (&cable);
+ *    report << my_adc << send_now;
+ *  \endcode
+ */
+
+class text_buffer : public base_text_serial
+    {
+    protected:
+        /// This holds the text which hasn't been passed on yet
+        char buffer[TEXT_BUFFER_SIZE];
+
+        /// This is how many characters are in the buffer
+        unsigned char length;
+
+        /// When this many characters are in the buffer, they're passed on
+        unsigned char threshold;
+
+        /// These are the ports to which the text is passed on
+        base_text_serial* p_outputs[TEXT_MAX_OUTPUTS];
+
+        /// This is how many ports there are to pass the text on to
+        unsigned char output_count;
+
+        /// This counts characters which were passed on, or thrown away if no ports
+        unsigned long passed_on;
+
+        // This method writes the buffer to each of the ports and empties it
+        bool pass_on (void);
+
+    public:
+        // The constructor makes an empty buffer which passes text on when it's full
+        text_buffer (unsigned char = TEXT_BUFFER_SIZE);
+
+        // This method adds a port to which the text will be passed on
+        bool add_output (base_text_serial*);
+
+        // These methods put characters in the buffer
+        bool putchar (char);
+        bool write (const void*, size_t);
+
+        // This method passes the text on to the ports and empties the buffer
+        void transmit_now (void);
+
+        // These methods give the text which hasn't been passed on yet
+        const char* get_text (void);
+        unsigned char get_length (void);
+        unsigned long get_passed_on (void);
+
+        // This method throws away the text in the buffer
+        void clear (void);
+    };
+
+#endif  // _TEXT_BUFFER_H_
@@ -0,0 +1,179 @@
+//*************************************************************************************
+/** \file text_stream.h
+ *        This file contains a template which gives a serial device the same "cout"
+ *        style << operators as base_text_serial, without virtual functions. The
+ *        device class is given to the template as a parameter, so each character
+ *        goes straight to the device's own putchar(), which the compiler can inline
+ *        right down to the register writes. Numbers are converted to text by the
+ *        num_format functions, just as in base_text_serial.
+ *
+ *        The price is that code which prints to such a device must know its type at
+ *        compile time; the << operators written for base_text_serial, such as the
+ *        one which prints an avr_adc, can't be used with it. Code which needs to
+ *        print to any kind of device should keep using base_text_serial.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ *      \li 10-16-26       Added printing of strings kept in program memory
+ *      \li 10-16-26       Signed numbers and bases done by the shared functions
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _TEXT_STREAM_H_
+#define _TEXT_STREAM_H_
+
+#include "base_text_serial.h"               // For the ser_manipulator codes
+#include "num_format.h"                     // Functions which convert numbers to text
+
+
+//-------------------------------------------------------------------------------------
+/** This template adds the << operators to a serial device class. The device class
+ *  derives from it, giving itself as the parameter, and supplies putchar(), puts()
+ *  and transmit_now() methods which don't need to be virtual:
+ *  \code
+ *    class my_port : public text_stream<my_port>
+ *  \endcode
+ *  @param DEVICE The class of the serial device which derives from this one
+ */
+
+template <class DEVICE>
+class text_stream
+    {
+    protected:
+        /// This is the currently used base for converting numbers to text
+        unsigned char base;
+
+        /// This method gives the device as its own type, so its methods are called
+        /// directly rather than through a virtual table
+        DEVICE& device (void) { return (*static_cast<DEVICE*> (this)); }
+
+    public:
+        /// The constructor sets the default base for numbers, which is decimal
+        text_stream (void) { base = 10; }
+
+        /** This operator writes a string which is kept in program memory, reading
+         *  each character from there as it's sent.
+         *  @param string The string to be written, from FLASH_STR()
+         */
+        DEVICE& operator<< (const flash_string* string)
+            {
+            const char* p_flash = reinterpret_cast<const char*> (string);
+            char ch;
+
+            while ((ch = pgm_read_byte (p_flash++)) != '\0')
+                device ().putchar (ch);
+
+            return (device ());
+            }
+
+        /** This operator writes a null terminated string.
+         *  @param string Pointer to the string to be written
+         */
+        DEVICE& operator<< (const char* string)
+            {
+            device ().puts (string);
+            return (device ());
+            }
+
+        /** This operator writes a boolean value as "T" or "F".
+         *  @param value The boolean value to be written
+         */
+        DEVICE& operator<< (bool value)
+            {
+            device ().putchar (value ? 'T' : 'F');
+            return (device ());
+            }
+
+        /** This operator writes an 8-bit unsigned number as text.
+         *  @param num The number to be written
+         */
+        DEVICE& operator<< (unsigned char num)
+            {
+            char out_str[9];
+
+            format_int ((unsigned int)num, base, 8, out_str);
+            device ().puts (out_str);
+            return (device ());
+            }
+
+        /** This operator writes an 8-bit signed number as text. In decimal, negative
+         *  numbers get a minus sign; in other bases the 8 bits are shown as they are.
+         *  @param num The number to be written
+         */
+        DEVICE& operator<< (char num)
+            {
+            char out_str[10];
+
+            format_signed ((signed char)num, base, 8, out_str);
+            device ().puts (out_str);
+            return (device ());
+            }
+
+        /** This operator writes a 16-bit unsigned number as text.
+         *  @param num The number to be written
+         */
+        DEVICE& operator<< (unsigned int num)
+            {
+            char out_str[17];
+
+            format_int (num, base, 16, out_str);
+            device ().puts (out_str);
+            return (device ());
+            }
+
+        /** This operator writes a 16-bit signed number as text. In decimal, negative
+         *  numbers get a minus sign; in other bases the 16 bits are shown as they are.
+         *  @param num The number to be written
+         */
+        DEVICE& operator<< (int num)
+            {
+            char out_str[18];
+
+            format_signed (num, base, 16, out_str);
+            device ().puts (out_str);
+            return (device ());
+            }
+
+        /** This operator writes a 32-bit unsigned number as text.
+         *  @param num The number to be written
+         */
+        DEVICE& operator<< (unsigned long num)
+            {
+            char out_str[NUM_FORMAT_SIZE];
+
+            format_long (num, base, out_str);
+            device ().puts (out_str);
+            return (device ());
+            }
+
+        /** This operator writes a 32-bit signed number as text. In decimal, negative
+         *  numbers get a minus sign; in other bases the 32 bits are shown as they are.
+         *  @param num The number to be written
+         */
+        DEVICE& operator<< (long num)
+            {
+            char out_str[NUM_FORMAT_SIZE];
+
+            format_signed_long (num, base, out_str);
+            device ().puts (out_str);
+            return (device ());
+            }
+
+        /** This operator handles the manipulators which change the base of numbers,
+         *  end a line, or ask for buffered data to be sent right away.
+         *  @param code The manipulator
+         */
+        DEVICE& operator<< (ser_manipulator code)
+            {
+            base = manipulator_base (code, base);
+
+            if (code == endl)
+                device ().puts ("\r\n");
+            else if (code == send_now)
+                device ().transmit_now ();
+            return (device ());
+            }
+    };
+
+#endif  // _TEXT_STREAM_H_
@@ -0,0 +1,130 @@
+//*************************************************************************************
+/** \file uart_baud.h
+ *        This file contains a template which works out the UART baud rate register
+ *        setting for a baud rate and CPU clock frequency. The compiler does all the
+ *        arithmetic, so the divisor, the U2X double speed choice, the baud rate which
+ *        will really be made, and how far off it is all come out as constants.
+ *
+ *        The UART makes its baud rate by dividing the CPU clock by 16 times one more
+ *        than the 12-bit UBRR divisor, or by 8 times that in double speed (U2X) mode.
+ *        Both are tried, and the one which comes closer to the baud rate asked for is
+ *        used; normal speed wins a tie, as the receiver samples each bit more times.
+ *        Double speed allows rates up to F_CPU / 8, such as 1 Mbaud at 8 MHz. A rate
+ *        which can't be made within UART_MAX_ERROR won't compile.
+ *
+ *  Revised:
+ *      \li 10-16-26       Original file
+ *      \li 10-16-26       Limited to normal speed and an 8-bit divisor on the AT90S2313
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _UART_BAUD_H_
+#define _UART_BAUD_H_
+
+
+/** This is the largest baud rate error allowed, in tenths of a percent. A receiver
+ *  can usually cope with about 2% when both ends are this close
+ */
+#ifndef UART_MAX_ERROR
+    #define UART_MAX_ERROR  20
+#endif
+
+/** These are the largest divisor the UBRR registers can hold, and whether the UART has
+ *  double speed mode. The AT90S2313's UART has only an 8-bit UBRR and no U2X bit, so a
+ *  rate which would need either one won't compile for it
+ */
+#ifdef __AVR_AT90S2313__
+    #define UART_MAX_DIVISOR    255
+    #define UART_HAS_U2X        false
+#else
+    #define UART_MAX_DIVISOR    4095
+    #define UART_HAS_U2X        true
+#endif
+
+
+//-------------------------------------------------------------------------------------
+/** This class holds a baud rate setting for a UART: the divisor for the UBRR register
+ *  and whether double speed mode is used. An rs232 object can be made with one of
+ *  these instead of a raw divisor.
+ */
+
+class uart_setting
+    {
+    public:
+        unsigned int divisor;               ///< Value for the UBRRH and UBRRL registers
+        bool double_speed;                  ///< True if the U2X bit is to be set
+
+        /** The constructor saves the setting.
+         *  @param new_divisor The value for the UBRR registers, from 0 to
+         *      UART_MAX_DIVISOR
+         *  @param new_double_speed True to use double speed mode
+         */
+        uart_setting (unsigned int new_divisor, bool new_double_speed)
+            {
+            divisor = new_divisor;
+            double_speed = new_double_speed;
+            }
+    };
+
+
+//-------------------------------------------------------------------------------------
+/** This template works out the baud rate setting for a CPU clock and baud rate. An
+ *  object of it is a uart_setting which can be given to an rs232 constructor:
+ *  \code
+ *    rs232 the_serial_port (uart_baud<F_CPU, 115200> (), 1);
+ *  \endcode
+ *  The constants can be used by themselves too, for example to print the rate.
+ *  @param CPU_HZ The CPU clock frequency in Hz, usually F_CPU
+ *  @param BAUD The baud rate wanted
+ */
+
+template <unsigned long CPU_HZ, unsigned long BAUD>
+class uart_baud : public uart_setting
+    {
+    protected:
+        /// These are the divisors plus one for normal and double speed, rounded
+        static const unsigned long NORMAL_PLUS_1 = (CPU_HZ + 8 * BAUD) / (16 * BAUD);
+        static const unsigned long DOUBLE_PLUS_1 = (CPU_HZ + 4 * BAUD) / (8 * BAUD);
+
+        /// These are the rates each one really makes; zero if it can't be used
+        static const unsigned long NORMAL_BAUD = (NORMAL_PLUS_1 >= 1
+            && NORMAL_PLUS_1 <= UART_MAX_DIVISOR + 1)
+            ? CPU_HZ / (16 * NORMAL_PLUS_1) : 0;
+        static const unsigned long DOUBLE_BAUD = (UART_HAS_U2X && DOUBLE_PLUS_1 >= 1
+            && DOUBLE_PLUS_1 <= UART_MAX_DIVISOR + 1)
+            ? CPU_HZ / (8 * DOUBLE_PLUS_1) : 0;
+
+        /// These are how far off each rate is, in Hz, whichever way
+        static const unsigned long NORMAL_OFF = (NORMAL_BAUD > BAUD)
+            ? NORMAL_BAUD - BAUD : BAUD - NORMAL_BAUD;
+        static const unsigned long DOUBLE_OFF = (DOUBLE_BAUD > BAUD)
+            ? DOUBLE_BAUD - BAUD : BAUD - DOUBLE_BAUD;
+
+    public:
+        /// This is true if double speed mode comes closer to the rate asked for
+        static const bool DOUBLE_SPEED = (DOUBLE_OFF < NORMAL_OFF);
+
+        /// This is the value for the UBRR registers
+        static const unsigned int DIVISOR = DOUBLE_SPEED ? DOUBLE_PLUS_1 - 1
+                                                         : NORMAL_PLUS_1 - 1;
+
+        /// This is the baud rate which the UART will really make
+        static const unsigned long ACTUAL_BAUD = DOUBLE_SPEED ? DOUBLE_BAUD
+                                                              : NORMAL_BAUD;
+
+        /// This is how far off the rate is, in tenths of a percent, toward zero
+        static const long ERROR_TENTHS = ((long)ACTUAL_BAUD - (long)BAUD) * 1000L
+            / (long)BAUD;
+
+    protected:
+        /// This causes a compiler error (negative array size) for a rate too far off
+        typedef char error_check[(ERROR_TENTHS <= UART_MAX_ERROR
+                                  && ERROR_TENTHS >= -UART_MAX_ERROR) ? 1 : -1];
+
+    public:
+        /// The constructor makes a setting from the constants worked out above
+        uart_baud (void) : uart_setting (DIVISOR, DOUBLE_SPEED) { }
+    };
+
+#endif  // _UART_BAUD_H_